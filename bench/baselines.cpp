@@ -0,0 +1,250 @@
+/*
+	Baseline comparison:  histogram_tracked against exact selection algorithms.
+
+	The same sliding-window stream runs through each engine, which reports
+		its quantiles every <hop> samples:
+
+		tracked     sliding_window over histogram_tracked
+		nth         std::nth_element over a copy of the window, per report
+		two-heap    quern::find_set_quantile over the window, per report
+		ostree      online order-statistic tree over (value, sequence) keys
+		            (GNU pb_ds; omitted where unavailable)
+
+	Throughput counts every sample pushed, including reports.
+
+	Each engine's error is measured against the exact answer under its own
+		definition of the quantile, shown in the "reference" column:
+
+		rank        the order statistic at 0-based rank floor(q*window)
+		interp      linear interpolation at position q*window between adjacent
+		            order statistics, as computed by find_set_quantile
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <quern/window.hpp>
+
+#if defined(__has_include)
+	#if __has_include(<ext/pb_ds/assoc_container.hpp>)
+		#include <ext/pb_ds/assoc_container.hpp>
+		#include <ext/pb_ds/tree_policy.hpp>
+		#define QUERN_HAVE_PBDS 1
+	#endif
+#endif
+
+#include "bench.hpp"
+
+
+using namespace quern::bench;
+
+using histogram_t = quern::histogram<float>;
+using tracked_t   = quern::histogram_tracked<histogram_t>;
+using window_t    = quern::sliding_window<tracked_t>;
+using fraction_t  = quern::quantile_fraction<histogram_t::index_t>;
+
+
+namespace
+{
+	struct options
+	{
+		size_t              window  = 4096, hop = 64, samples = size_t(1) << 20;
+		size_t              bins    = 4096;
+		std::vector<size_t> dists   = {UNIFORM, HEAVY_TAILED, DRIFTING, BIMODAL};
+		std::vector<double> quantiles = {.5, .9, .99};
+		uint64_t            seed    = 1;
+	};
+
+	void usage()
+	{
+		std::printf(
+			"usage: quern_bench_baselines [options]\n"
+			"  --window N        window size (default 4096)\n"
+			"  --hop N           samples between reports (default 64)\n"
+			"  --samples N       stream length (default 1048576)\n"
+			"  --bins N          histogram bins over [0,1) (default 4096)\n"
+			"  --quantiles LIST  eg 0.5,0.9,0.99 (default)\n"
+			"  --dist LIST       distributions: 0 uniform, 1 heavy, 2 drifting, 3 bimodal\n"
+			"  --seed N          random seed (default 1)\n");
+	}
+
+	size_t rank_of(double q, size_t window)    {return std::min(window - 1, size_t(q * window));}
+
+
+#if QUERN_HAVE_PBDS
+	/*
+		Online order-statistic window:  a balanced tree keyed by (value, sequence number),
+			so equal values stay distinct and each sample can be erased when it leaves.
+	*/
+	using ostree_t = __gnu_pbds::tree<
+		std::pair<float, uint64_t>, __gnu_pbds::null_type, std::less<std::pair<float, uint64_t>>,
+		__gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update>;
+#endif
+
+
+	struct engine_result
+	{
+		double              seconds = 0;
+		std::vector<double> reports; // quantile values, in report order
+	};
+
+	template<typename Push, typename Report>
+	engine_result run_engine(const options &o, const std::vector<float> &stream, Push &&push, Report &&report)
+	{
+		engine_result r;
+		r.reports.reserve((stream.size() / o.hop + 1) * o.quantiles.size());
+		auto start = clock::now();
+		for (size_t i = 0; i < stream.size(); ++i)
+		{
+			push(i);
+			if (i + 1 >= o.window && (i + 1) % o.hop == 0) report(i + 1, r.reports);
+		}
+		r.seconds = elapsed_ns(start, clock::now()) * 1e-9;
+		return r;
+	}
+
+	void print(const char *engine, DISTRIBUTION dist, const options &o, size_t samples,
+		const engine_result &r, const engine_result &exact, bool interpolated = false)
+	{
+		double sum = 0, worst = 0;
+		for (size_t i = 0; i < r.reports.size(); ++i)
+		{
+			double e = std::fabs(r.reports[i] - exact.reports[i]);
+			sum += e;
+			worst = std::max(worst, e);
+		}
+		std::printf("%-9s %-9s %7zu %5zu %-9s %13.3g %12.3g %12.3g\n",
+			engine, distribution_name(dist), o.window, o.hop, interpolated ? "interp" : "rank",
+			samples / r.seconds, r.reports.empty() ? 0.0 : sum / r.reports.size(), worst);
+		std::fflush(stdout);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string {if (i+1 >= argc) {usage(); std::exit(2);} return argv[++i];};
+
+		if      (arg == "--window")  o.window  = std::stoull(value());
+		else if (arg == "--hop")     o.hop     = std::stoull(value());
+		else if (arg == "--samples") o.samples = std::stoull(value());
+		else if (arg == "--bins")    o.bins    = std::stoull(value());
+		else if (arg == "--seed")    o.seed    = std::stoull(value());
+		else if (arg == "--dist")    o.dists   = parse_list(value());
+		else if (arg == "--quantiles")
+		{
+			o.quantiles.clear();
+			auto list = value();
+			for (size_t start = 0; start <= list.size();)
+			{
+				size_t end = std::min(list.find(',', start), list.size());
+				o.quantiles.push_back(std::stod(list.substr(start, end - start)));
+				start = end + 1;
+			}
+		}
+		else {usage(); return (arg == "--help") ? 0 : 2;}
+	}
+	if (!o.window || !o.hop || o.samples < o.window) {usage(); return 2;}
+	for (size_t d : o.dists) if (d >= DISTRIBUTION_COUNT)
+	{
+		std::fprintf(stderr, "quern_bench_baselines: unknown distribution %zu\n", d);
+		return 2;
+	}
+
+	std::vector<fraction_t> fractions;
+	for (double q : o.quantiles) fractions.emplace_back(fraction_t(histogram_t::index_t(std::lround(q * 1e6)), 1000000));
+
+	std::printf("%-9s %-9s %7s %5s %-9s %13s %12s %12s\n",
+		"engine", "dist", "window", "hop", "reference", "samples/s", "mean err", "max err");
+
+	for (size_t d : o.dists)
+	{
+		auto dist   = DISTRIBUTION(d);
+		auto stream = make_stream(dist, o.samples, o.seed);
+
+		// Exact reference:  nth_element over each window.
+		std::vector<float> scratch(o.window);
+		auto exact = run_engine(o, stream, [](size_t) {},
+			[&](size_t end, std::vector<double> &out)
+			{
+				for (double q : o.quantiles)
+				{
+					std::copy(stream.begin() + (end - o.window), stream.begin() + end, scratch.begin());
+					auto k = scratch.begin() + rank_of(q, o.window);
+					std::nth_element(scratch.begin(), k, scratch.end());
+					out.push_back(*k);
+				}
+			});
+		print("nth", dist, o, stream.size(), exact, exact);
+
+		// Interpolated reference, matching find_set_quantile's convention (untimed).
+		auto interp = run_engine(o, stream, [](size_t) {},
+			[&](size_t end, std::vector<double> &out)
+			{
+				for (double q : o.quantiles)
+				{
+					std::copy(stream.begin() + (end - o.window), stream.begin() + end, scratch.begin());
+					double pos = q * o.window;
+					size_t k   = rank_of(q, o.window);
+					std::nth_element(scratch.begin(), scratch.begin() + k, scratch.end());
+					double lo = scratch[k], hi = lo;
+					if (k + 1 < o.window) hi = *std::min_element(scratch.begin() + k + 1, scratch.end());
+					out.push_back(lo + (hi - lo) * std::min(1.0, pos - double(k)));
+				}
+			});
+
+		{
+			window_t window(o.window, histogram_t::params_t{0.f, 1.f, quern::bindex_t(o.bins)}, fractions);
+			auto &rule = window.histogram().binning();
+			auto r = run_engine(o, stream, [&](size_t i) {window.push(stream[i]);},
+				[&](size_t, std::vector<double> &out)
+				{
+					for (auto &q : window.quantiles())
+						out.push_back(.5 * (rule.mid({q.index_range.lower}) + rule.mid({q.index_range.upper})));
+				});
+			print("tracked", dist, o, stream.size(), r, exact);
+		}
+
+		{
+			struct span_t
+			{
+				const float *b, *e;
+				const float *begin() const    {return b;}
+				const float *end  () const    {return e;}
+			};
+			auto r = run_engine(o, stream, [](size_t) {},
+				[&](size_t end, std::vector<double> &out)
+				{
+					span_t span = {stream.data() + (end - o.window), stream.data() + end};
+					for (double q : o.quantiles) out.push_back(quern::find_set_quantile(span, q));
+				});
+			print("two-heap", dist, o, stream.size(), r, interp, true);
+		}
+
+#if QUERN_HAVE_PBDS
+		{
+			ostree_t tree;
+			auto r = run_engine(o, stream,
+				[&](size_t i)
+				{
+					tree.insert({stream[i], uint64_t(i)});
+					if (i >= o.window) tree.erase({stream[i - o.window], uint64_t(i - o.window)});
+				},
+				[&](size_t, std::vector<double> &out)
+				{
+					for (double q : o.quantiles) out.push_back(tree.find_by_order(rank_of(q, o.window))->first);
+				});
+			print("ostree", dist, o, stream.size(), r, exact);
+		}
+#endif
+	}
+	return 0;
+}
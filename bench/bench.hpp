@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "perf_counters.hpp"
+#include "random.hpp"
+
+
+/*
+	Shared benchmark harness:  reproducible sample streams, timing and reporting.
+*/
+
+namespace quern
+{
+	namespace bench
+	{
+		/*
+			Input distributions.  Values fall mostly within [0, 1).
+		*/
+		enum DISTRIBUTION
+		{
+			UNIFORM      = 0, // uniform over [0, 1)
+			HEAVY_TAILED = 1, // Pareto tail from 0; extremes overflow the binning range
+			DRIFTING     = 2, // narrow normal whose center wanders across the range
+			BIMODAL      = 3, // two narrow, well-separated modes
+			DISTRIBUTION_COUNT
+		};
+
+		inline const char *distribution_name(DISTRIBUTION d)
+		{
+			static const char *names[] = {"uniform", "heavy", "drifting", "bimodal"};
+			return names[d];
+		}
+
+		inline std::vector<float> make_stream(DISTRIBUTION dist, size_t count, uint64_t seed)
+		{
+			random rng(seed * 0x100000001B3ull + dist);
+			std::vector<float> samples(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				double x = 0.0;
+				switch (dist)
+				{
+				case UNIFORM:      x = rng.uniform(); break;
+				case HEAVY_TAILED: x = .002 * (std::pow(1.0 - rng.uniform(), -1.0/1.2) - 1.0); break;
+				case DRIFTING:     x = .5 + .4 * std::sin(25.132741228718345 * i / double(count)) + .03 * rng.normal(); break;
+				case BIMODAL:      x = ((rng.next() & 1) ? .25 : .75) + .03 * rng.normal(); break;
+				default: break;
+				}
+				samples[i] = float(x);
+			}
+			return samples;
+		}
+
+
+		/*
+			Prevent the optimizer from discarding a computed value.
+		*/
+		template<typename T>
+		inline void keep(const T &value)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			asm volatile("" : : "r,m"(value) : "memory");
+#else
+			static volatile T sink; sink = value;
+#endif
+		}
+
+
+		/*
+			Timing results for one benchmark case.
+		*/
+		struct latency_stats
+		{
+			size_t ops = 0;
+			double ns_per_op = 0;                            // from an uninterrupted run
+			double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0; // from individually timed ops
+			perf_sample perf;                                    // from the uninterrupted run, if counted
+		};
+
+		using clock = std::chrono::steady_clock;
+
+		inline double elapsed_ns(clock::time_point a, clock::time_point b)
+		{
+			return double(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+		}
+
+		// Estimate the cost of reading the clock, which is subtracted from per-op latencies.
+		inline double clock_overhead_ns()
+		{
+			static double overhead = -1;
+			if (overhead < 0)
+			{
+				overhead = 1e9;
+				for (int i = 0; i < 1000; ++i)
+				{
+					auto a = clock::now(), b = clock::now();
+					overhead = std::min(overhead, elapsed_ns(a, b));
+				}
+			}
+			return overhead;
+		}
+
+
+		/*
+			Run a benchmark case:  setup() prepares fresh state, op(i) performs operation i.
+				The case runs twice, once uninterrupted for throughput and once timing each op.
+				If <counters> is given, hardware counters are read around the uninterrupted run.
+		*/
+		template<typename Setup, typename Op>
+		latency_stats measure(size_t ops, Setup &&setup, Op &&op, perf_counters *counters = nullptr)
+		{
+			latency_stats s;
+			s.ops = ops;
+			if (!ops) return s;
+
+			setup();
+			if (counters) counters->start();
+			auto start = clock::now();
+			for (size_t i = 0; i < ops; ++i) op(i);
+			auto end = clock::now();
+			if (counters) s.perf = counters->stop(ops);
+			s.ns_per_op = elapsed_ns(start, end) / double(ops);
+
+			double overhead = clock_overhead_ns();
+			std::vector<float> lat(ops);
+			setup();
+			for (size_t i = 0; i < ops; ++i)
+			{
+				auto a = clock::now();
+				op(i);
+				auto b = clock::now();
+				lat[i] = float(std::max(elapsed_ns(a, b) - overhead, 0.0));
+			}
+
+			auto pct = [&](double p) -> double
+			{
+				size_t k = std::min(ops - 1, size_t(p * (ops - 1) + .5));
+				std::nth_element(lat.begin(), lat.begin() + k, lat.end());
+				return lat[k];
+			};
+			s.p50  = pct(.5);
+			s.p90  = pct(.9);
+			s.p99  = pct(.99);
+			s.p999 = pct(.999);
+			s.max  = *std::max_element(lat.begin(), lat.end());
+			return s;
+		}
+
+
+		/*
+			Parse a comma-separated list of integers.
+		*/
+		inline std::vector<size_t> parse_list(const std::string &text)
+		{
+			std::vector<size_t> list;
+			for (size_t start = 0; start <= text.size();)
+			{
+				size_t end = std::min(text.find(',', start), text.size());
+				list.push_back(std::stoull(text.substr(start, end - start)));
+				start = end + 1;
+			}
+			return list;
+		}
+	}
+}
@@ -0,0 +1,209 @@
+/*
+	Microbenchmarks for the tracked-histogram hot paths.
+
+	Sweeps bin counts, tracked-quantile counts, window sizes and input
+		distributions, reporting ns/op and per-op latency percentiles for:
+
+		index      binning::index
+		insert     histogram_tracked::insert into an empty window
+		remove     histogram_tracked::remove from a full window
+		replace    histogram_tracked::replace in a full sliding window
+		find       find_quantile_indexes on a full histogram
+		recalc     histogram_tracked::recalculate on a full histogram
+
+	With --perf, hardware counters (cycles, instructions, branch and cache misses)
+		are also reported per operation, or "n/a" where the system doesn't provide them.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include <quern/histogram_tracked.hpp>
+
+#include "bench.hpp"
+
+
+using namespace quern::bench;
+
+using histogram_t = quern::histogram<float>;
+using tracked_t   = quern::histogram_tracked<histogram_t>;
+using fraction_t  = quern::quantile_fraction<histogram_t::index_t>;
+
+
+namespace
+{
+	struct options
+	{
+		std::vector<size_t>      bins      = {32, 1024, 32768, 1048576};
+		std::vector<size_t>      quantiles = {1, 10, 100, 1000};
+		std::vector<size_t>      windows   = {1024, 65536};
+		std::vector<size_t>      dists     = {UNIFORM, HEAVY_TAILED, DRIFTING, BIMODAL};
+		std::vector<std::string> ops       = {"index", "insert", "remove", "replace", "find", "recalc"};
+		size_t                   replaces  = size_t(1) << 18;
+		uint64_t                 seed      = 1;
+		bool                     perf      = false;
+	};
+
+	void usage()
+	{
+		std::printf(
+			"usage: quern_bench [options]\n"
+			"  --bins LIST       bin counts (default 32,1024,32768,1048576)\n"
+			"  --quantiles LIST  tracked quantile counts (default 1,10,100,1000)\n"
+			"  --window LIST     window sizes (default 1024,65536)\n"
+			"  --dist LIST       distributions: 0 uniform, 1 heavy, 2 drifting, 3 bimodal\n"
+			"  --ops LIST        any of index,insert,remove,replace,find,recalc\n"
+			"  --replaces N      replace operations per case (default 262144)\n"
+			"  --seed N          random seed (default 1)\n"
+			"  --quick           small sweep for smoke testing\n"
+			"  --perf            report hardware performance counters per op\n");
+	}
+
+	// Evenly spaced quantiles i/(count+1).
+	std::vector<fraction_t> make_quantiles(size_t count)
+	{
+		std::vector<fraction_t> list;
+		for (size_t i = 1; i <= count; ++i) list.emplace_back(fraction_t(i, count+1));
+		return list;
+	}
+
+	bool has_op(const options &o, const char *name)
+	{
+		for (auto &op : o.ops) if (op == name) return true;
+		return false;
+	}
+
+	perf_counters *counters = nullptr;
+
+	void report(const char *op, DISTRIBUTION dist, size_t bins, size_t quantiles, size_t window, const latency_stats &s)
+	{
+		std::printf("%-8s %-9s %8zu %6zu %7zu %9zu %10.1f %8.0f %8.0f %8.0f %8.0f %10.0f",
+			op, distribution_name(dist), bins, quantiles, window, s.ops,
+			s.ns_per_op, s.p50, s.p90, s.p99, s.p999, s.max);
+		if (counters) print_perf(s.perf);
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string {if (i+1 >= argc) {usage(); std::exit(2);} return argv[++i];};
+
+		if      (arg == "--bins")      o.bins      = parse_list(value());
+		else if (arg == "--quantiles") o.quantiles = parse_list(value());
+		else if (arg == "--window")    o.windows   = parse_list(value());
+		else if (arg == "--dist")      o.dists     = parse_list(value());
+		else if (arg == "--replaces")  o.replaces  = std::stoull(value());
+		else if (arg == "--seed")      o.seed      = std::stoull(value());
+		else if (arg == "--ops")
+		{
+			o.ops.clear();
+			auto list = value();
+			for (size_t start = 0; start <= list.size();)
+			{
+				size_t end = std::min(list.find(',', start), list.size());
+				o.ops.push_back(list.substr(start, end - start));
+				start = end + 1;
+			}
+		}
+		else if (arg == "--perf")      o.perf      = true;
+		else if (arg == "--quick")
+		{
+			o.bins = {32, 4096}; o.quantiles = {1, 10}; o.windows = {1024}; o.replaces = 1 << 14;
+		}
+		else {usage(); return (arg == "--help") ? 0 : 2;}
+	}
+	for (size_t d : o.dists) if (d >= DISTRIBUTION_COUNT)
+	{
+		std::fprintf(stderr, "quern_bench: unknown distribution %zu\n", d);
+		return 2;
+	}
+
+	std::optional<perf_counters> perf;
+	if (o.perf)
+	{
+		counters = &perf.emplace();
+		if (!counters->available()) std::fprintf(stderr, "quern_bench: performance counters unavailable\n");
+	}
+
+	std::printf("%-8s %-9s %8s %6s %7s %9s %10s %8s %8s %8s %8s %10s",
+		"op", "dist", "bins", "quant", "window", "ops", "ns/op", "p50", "p90", "p99", "p99.9", "max");
+	if (counters) print_perf_header();
+	std::printf("\n");
+
+	for (size_t d : o.dists)
+	{
+		auto dist = DISTRIBUTION(d);
+		size_t longest = *std::max_element(o.windows.begin(), o.windows.end()) + o.replaces;
+		auto stream = make_stream(dist, longest, o.seed);
+
+		for (size_t bins : o.bins)
+		{
+			histogram_t::params_t params = {0.f, 1.f, quern::bindex_t(bins)};
+
+			if (has_op(o, "index"))
+			{
+				quern::binning<float> rule(params);
+				auto s = measure(o.replaces, []{}, [&](size_t i) {keep(rule.index(stream[i]));}, counters);
+				report("index", dist, bins, 0, 0, s);
+			}
+
+			for (size_t window : o.windows)
+			{
+				if (has_op(o, "find"))
+				{
+					histogram_t hist(params);
+					for (size_t i = 0; i < window; ++i) hist.add(stream[i]);
+					auto fractions = make_quantiles(9);
+					size_t ops = std::max<size_t>(16, (size_t(1) << 24) / bins);
+					auto s = measure(ops, []{},
+						[&](size_t i) {keep(quern::find_quantile_indexes(hist, fractions[i % fractions.size()]).lower);}, counters);
+					report("find", dist, bins, fractions.size(), window, s);
+				}
+
+				for (size_t count : o.quantiles)
+				{
+					auto fractions = make_quantiles(count);
+					tracked_t tracked;
+
+					auto fresh = [&] {tracked = tracked_t(params, fractions);};
+					auto full  = [&] {fresh(); for (size_t i = 0; i < window; ++i) tracked.insert(stream[i]);};
+
+					if (has_op(o, "insert"))
+					{
+						auto s = measure(window, fresh, [&](size_t i) {tracked.insert(stream[i]);}, counters);
+						report("insert", dist, bins, count, window, s);
+					}
+					if (has_op(o, "remove"))
+					{
+						auto s = measure(window, full, [&](size_t i) {tracked.remove(stream[i]);}, counters);
+						report("remove", dist, bins, count, window, s);
+					}
+					if (has_op(o, "replace"))
+					{
+						auto s = measure(o.replaces, full, [&](size_t i) {tracked.replace(stream[window+i], stream[i]);}, counters);
+						report("replace", dist, bins, count, window, s);
+					}
+					if (has_op(o, "recalc"))
+					{
+						// Each recalculation scans the histogram once per quantile.
+						size_t ops = std::max<size_t>(1, (size_t(1) << 26) / (bins * count));
+						auto s = measure(ops, full, [&](size_t) {tracked.recalculate();}, counters);
+						report("recalc", dist, bins, count, window, s);
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+
+/*
+	Hardware performance counters for the benchmark harness, via Linux perf_event_open.
+
+	All counters are opened as one group so they cover exactly the same interval.
+		Counters the kernel or hardware refuses (common in VMs and containers, or when
+		perf_event_paranoid is restrictive) are reported as unavailable rather than failing.
+*/
+
+namespace quern
+{
+	namespace bench
+	{
+		enum PERF_COUNTER
+		{
+			PERF_CYCLES       = 0,
+			PERF_INSTRUCTIONS = 1,
+			PERF_BRANCH_MISS  = 2,
+			PERF_L1D_MISS     = 3, // L1 data cache read misses
+			PERF_LLC_MISS     = 4, // last-level cache misses
+			PERF_COUNTER_COUNT
+		};
+
+		inline const char *perf_counter_name(PERF_COUNTER c)
+		{
+			static const char *names[] = {"cycles", "instr", "br-miss", "L1d-miss", "LLC-miss"};
+			return names[c];
+		}
+
+
+		/*
+			Counter totals for one measured interval, divided by the operation count.
+				Unavailable counters have valid[c] == false.
+		*/
+		struct perf_sample
+		{
+			bool   valid[PERF_COUNTER_COUNT] = {};
+			double per_op[PERF_COUNTER_COUNT] = {};
+
+			bool any() const    {for (bool v : valid) if (v) return true; return false;}
+		};
+
+
+		class perf_counters
+		{
+		public:
+			perf_counters()
+			{
+				for (auto &fd : _fd) fd = -1;
+				for (auto &slot : _slot) slot = -1;
+#if defined(__linux__)
+				static const struct {uint32_t type; uint64_t config;} events[PERF_COUNTER_COUNT] =
+				{
+					{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+					{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+					{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+					{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+						| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+					{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+				};
+				int leader = -1, slots = 0;
+				for (int c = 0; c < PERF_COUNTER_COUNT; ++c)
+				{
+					perf_event_attr attr;
+					std::memset(&attr, 0, sizeof(attr));
+					attr.size           = sizeof(attr);
+					attr.type           = events[c].type;
+					attr.config         = events[c].config;
+					attr.disabled       = (leader < 0);
+					attr.exclude_kernel = 1;
+					attr.exclude_hv     = 1;
+					attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+					int fd = int(::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+					if (fd < 0) continue;
+					if (leader < 0) leader = fd;
+					_fd[c]   = fd;
+					_slot[c] = slots++;
+				}
+				_leader = leader;
+#endif
+			}
+			~perf_counters()
+			{
+#if defined(__linux__)
+				for (int fd : _fd) if (fd >= 0) ::close(fd);
+#endif
+			}
+			perf_counters(const perf_counters&) = delete;
+			perf_counters &operator=(const perf_counters&) = delete;
+
+			// True if at least one counter could be opened.
+			bool available() const noexcept    {return _leader >= 0;}
+
+			void start()
+			{
+#if defined(__linux__)
+				if (_leader < 0) return;
+				::ioctl(_leader, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+				::ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+			}
+
+			// Stop counting and return totals divided by <ops>, scaled for multiplexing.
+			perf_sample stop(size_t ops)
+			{
+				perf_sample s;
+#if defined(__linux__)
+				if (_leader < 0) return s;
+				::ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+				uint64_t data[3 + PERF_COUNTER_COUNT] = {};
+				if (::read(_leader, data, sizeof(data)) < ssize_t(3 * sizeof(uint64_t))) return s;
+
+				uint64_t count = data[0], enabled = data[1], running = data[2];
+				if (!running) return s;
+				double scale = double(enabled) / double(running) / double(ops ? ops : 1);
+				for (int c = 0; c < PERF_COUNTER_COUNT; ++c)
+				{
+					if (_slot[c] < 0 || uint64_t(_slot[c]) >= count) continue;
+					s.valid[c]  = true;
+					s.per_op[c] = double(data[3 + _slot[c]]) * scale;
+				}
+#else
+				(void) ops;
+#endif
+				return s;
+			}
+
+		private:
+			int _fd[PERF_COUNTER_COUNT], _slot[PERF_COUNTER_COUNT];
+			int _leader = -1;
+		};
+
+
+		/*
+			Print the counter column headers, or one row of per-op counter figures.
+		*/
+		inline void print_perf_header()
+		{
+			for (int c = 0; c < PERF_COUNTER_COUNT; ++c) std::printf(" %9s", perf_counter_name(PERF_COUNTER(c)));
+			std::printf(" %6s", "IPC");
+		}
+		inline void print_perf(const perf_sample &s)
+		{
+			for (int c = 0; c < PERF_COUNTER_COUNT; ++c)
+			{
+				if (s.valid[c]) std::printf(" %9.2f", s.per_op[c]);
+				else            std::printf(" %9s", "n/a");
+			}
+			if (s.valid[PERF_CYCLES] && s.valid[PERF_INSTRUCTIONS] && s.per_op[PERF_CYCLES] > 0)
+				std::printf(" %6.2f", s.per_op[PERF_INSTRUCTIONS] / s.per_op[PERF_CYCLES]);
+			else
+				std::printf(" %6s", "n/a");
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+
+namespace quern
+{
+	namespace bench
+	{
+		/*
+			Reproducible random numbers (splitmix64), identical on every platform.
+				Shared by the benchmarks and the stress test.
+		*/
+		struct random
+		{
+			uint64_t state;
+
+			explicit random(uint64_t seed) : state(seed) {}
+
+			uint64_t next()
+			{
+				uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				return z ^ (z >> 31);
+			}
+
+			// Uniform in [0, n), or 0 if n is 0
+			uint64_t below(uint64_t n)    {return n ? next() % n : 0;}
+
+			// Uniform in [0, 1)
+			double uniform()    {return (next() >> 11) * (1.0 / 9007199254740992.0);}
+
+			// Standard normal (Box-Muller)
+			double normal()
+			{
+				double u = 1.0 - uniform(), v = uniform();
+				return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * v);
+			}
+		};
+	}
+}
@@ -12,7 +12,8 @@ namespace quern
 	template<
 		typename Key,
 		typename Value,
-		typename Binning = binning<Key> >
+		typename Binning = binning<Key>,
+		typename Storage = grid_storage<Value> >
 	class bin_table : public grid_base
 	{
 	public:
@@ -24,7 +25,10 @@ namespace quern
 		using params_t  = typename binning_t::params_t;
 
 		// Base grid type
-		using grid_t    = grid<Value, dof_count<Key>>;
+		using grid_t    = quern::grid<Value, dof_count<Key>, Storage>;
+		using storage_t = typename grid_t::storage_t;
+
+		using allocator_type = typename grid_t::allocator_type;
 		using value_t   = typename grid_t::value_t;
 		using index_t   = typename grid_t::index_t;
 		using coord_t   = typename grid_t::coord_t;
@@ -96,12 +100,19 @@ namespace quern
 			Default constructor.  We won't be able to add samples...
 		*/
 		explicit bin_table() {}
+		explicit bin_table(const allocator_type &alloc) : _grid(alloc) {}
 
 		/*
 			Set up empty bins based on an array of binning rules.
 		*/
-		bin_table(const binning_t &binning, const value_t &fill = value_t{})
-			: _grid(binning.grid_size(), fill), _binning(binning) {}
+		bin_table(const binning_t &binning, const value_t &fill = value_t{}, const allocator_type &alloc = allocator_type())
+			: _grid(binning.grid_size(), fill, alloc), _binning(binning) {}
+
+		/*
+			Set up bins over existing storage, keeping its contents.
+		*/
+		bin_table(const binning_t &binning, storage_t &&store)
+			: _grid(binning.grid_size(), std::move(store)), _binning(binning) {}
 
 		/*
 			Clear all values in the BinMap.
@@ -123,7 +134,8 @@ namespace quern
 		/*
 			Access the underlying data grid.
 		*/
-		const grid_t &grid() const    {return _grid;}
+		const grid_t  &grid()          const    {return _grid;}
+		allocator_type get_allocator() const    {return _grid.get_allocator();}
 
 
 		/*
@@ -154,6 +166,13 @@ namespace quern
 		coord_t        coord_for(const key_t &key) const    {return _binning.coord(key); }
 		index_t        index_for(const key_t &key) const    {return coord_to_index(coord_for(key));}
 
+		/*
+			Get the indices for <count> keys given as columns, one per element of the key
+				(or one column for a primitive key), matching the key's element order.
+		*/
+		template<typename... Columns>
+		void index_for_columns(index_t *out, size_t count, const Columns*... columns) const    {_binning.index_batch(out, count, columns...);}
+
 		template<typename R>
 		coord_frac_t<R> coord_frac_for(const key_t &key) const    {return _binning.template coord_frac<R>(key);}
 
@@ -7,6 +7,7 @@
 #include <type_traits>
 #include <algorithm>
 #include <array>
+#include <limits>
 #include <vector>
 #include <stdint.h>
 
@@ -122,6 +123,14 @@ namespace quern
 		bindex_t accept(const T&) const; // return whether a value can be binned
 		bindex_t reject(const T&) const; // return whether a value cannot be binned
 
+		/*
+			Batched binning over structure-of-arrays input:  one column per element of T.
+				index_batch writes linear grid indexes (BIN_REJECT if any element is rejected);
+				coord_batch writes one coordinate column per axis.
+		*/
+		template<typename... Columns> void index_batch(bindex_t *out,                       size_t count, const Columns*... columns) const;
+		template<typename... Columns> void coord_batch(const std::array<bindex_t*, dof> &out, size_t count, const Columns*... columns) const;
+
 		template<typename R>
 		bin_coord_frac_t<R, 0> coord_frac(const T&) const;
 	};
@@ -180,15 +189,31 @@ namespace quern
 		index_t bins()     const    {return _bins;}
 		coord_t grid_size() const    {return {bins()};}
 
-		// binning queries.
-		bool     accept(const T v) const    {return v >= _min && v <  _max;}
-		bool     reject(const T v) const    {return v <  _min || v >= _max;}
+		// binning queries.  NaN is rejected.
+		bool     accept(const T v) const    {return   v >= _min && v <  _max;}
+		bool     reject(const T v) const    {return !(v >= _min && v <  _max);}
 		coord_t  coord (const T v) const    {return {index(v)};}
 		bindex_t index (const T v) const
 		{
 			return reject(v) ? BIN_REJECT : std::min(_vi(v), _bins-1);
 		}
 
+		// Batched index(), with the same results.  Bins are computed in 32 bits where
+		//   the last bin is exactly representable in both T and int32_t, and without
+		//   branches, so the loop can vectorize.
+		void index_batch(bindex_t *out, size_t count, const T *values) const
+		{
+			if (!_exact_32()) {for (size_t i = 0; i < count; ++i) out[i] = index(values[i]); return;}
+
+			const T last = T(_bins-1);
+			for (size_t i = 0; i < count; ++i)
+			{
+				T    v  = values[i], f = std::min((v-_min)/_step, last);
+				bool ok = (v >= _min) & (v < _max);
+				out[i]  = ok ? bindex_t(int32_t(ok ? f : T(0))) : bindex_t(BIN_REJECT);
+			}
+		}
+
 		// Real-valued coordinate
 		template<typename R>
 		bin_coord_frac_t<R, 1> coord_frac(const T v) const    {return {(v-_min)/_step - R(.5)};}
@@ -200,6 +225,12 @@ namespace quern
 		
 		// subroutines
 		index_t _vi(const T v) const    {return index_t((v-_min)/_step);}
+
+		bool _exact_32() const
+		{
+			constexpr int bits = std::min(std::numeric_limits<T>::digits, 31);
+			return _bins <= (bindex_t(1) << bits);
+		}
 	};
 
 	// binning for booleans.
@@ -253,6 +284,8 @@ namespace quern
 		coord_t coord (const T v) const    {return {index(v)};}
 		index_t index (const T v) const    {return v ? 1 : 0;}
 
+		void index_batch(bindex_t *out, size_t count, const T *values) const    {for (size_t i = 0; i < count; ++i) out[i] = index(values[i]);}
+
 		// Real-valued coordinate
 		template<typename R>
 		bin_coord_frac_t<R, 1> coord_frac(const T v) const    {return {v ? R(1) : R(0)};}
@@ -319,6 +352,8 @@ namespace quern
 			return reject(v) ? BIN_REJECT : _vi(v);
 		}
 
+		void index_batch(bindex_t *out, size_t count, const T *values) const    {for (size_t i = 0; i < count; ++i) out[i] = index(values[i]);}
+
 		// Real-valued coordinate
 		template<typename R>
 		bin_coord_frac_t<R, 1> coord_frac(const T v) const    {return {v-_min};}
@@ -92,7 +92,7 @@ namespace quern
 	template<class T>
 	struct binning_params_<T, std::enable_if_t<!dof_is_primitive<T> && (dof_count<T> > 0)>>
 	{
-		using _tuples  = detail::BinningTuples<typename DOF_Info<T>::tuple_t>;
+		using _tuples  = detail::BinningTuples<typename dof_info<T>::tuple_t>;
 		using _indices = typename _tuples::indices;
 
 
@@ -157,6 +157,35 @@ namespace quern
 			bin_coord_frac_t<R, dof> c; _coord_frac(c, v);
 			return c;
 		}
+
+		/*
+			Batched binning over structure-of-arrays input, one column per element, in element order.
+				index_batch fuses each axis's binning with the row-major stride multiply and
+				writes linear grid indexes directly; a sample rejected on any axis yields BIN_REJECT.
+				coord_batch writes one coordinate column per axis.  Work proceeds in cache-sized
+				chunks, one branch-free pass per axis, so the inner loops can vectorize.
+
+			Batching requires every element to be a scalar with one degree of freedom
+				(batchable); a value such as std::tuple<std::complex<float>, float> should be
+				split into three scalar columns and binned as std::tuple<float, float, float>.
+		*/
+		static constexpr bool batchable = (dof == dof_info<T>::elems);
+
+		template<typename... Columns>
+		void index_batch(bindex_t *out, size_t count, const Columns*... columns) const
+		{
+			static_assert(batchable, "index_batch needs one degree of freedom per element; split multi-dof elements into scalar columns");
+			static_assert(sizeof...(Columns) == _elems, "index_batch takes one column per element");
+			_index_batch(out, count, std::make_index_sequence<_elems>(), columns...);
+		}
+
+		template<typename... Columns>
+		void coord_batch(const std::array<bindex_t*, dof> &out, size_t count, const Columns*... columns) const
+		{
+			static_assert(batchable, "coord_batch needs one degree of freedom per element; split multi-dof elements into scalar columns");
+			static_assert(sizeof...(Columns) == _elems, "coord_batch takes one column per element");
+			_coord_batch(out, count, std::make_index_sequence<_elems>(), columns...);
+		}
 		
 	private:
 		typename _tuples::SubBinning _sub;
@@ -168,7 +197,39 @@ namespace quern
 
 	private:
 		// Implementation
-		static const size_t _n_elems = dof_info<T>::elems - 1;
+		static const size_t _elems   = dof_info<T>::elems;
+		static const size_t _n_elems = _elems - 1;
+		static constexpr size_t _batch = 256;
+
+		template<size_t I> using _column_t = typename std::tuple_element<I, typename dof_info<T>::tuple_t>::type;
+
+		// Fold axis I into the running linear indexes.  count <= _batch.
+		template<size_t I>
+		void _index_axis(bindex_t *out, size_t count, const _column_t<I> *column) const
+		{
+			if (I == 0) {element<I>().index_batch(out, count, column); return;}
+
+			bindex_t c[_batch], bins = element<I>().bins();
+			element<I>().index_batch(c, count, column);
+			for (size_t k = 0; k < count; ++k)
+				out[k] = ((out[k] | c[k]) < 0) ? bindex_t(BIN_REJECT) : out[k] * bins + c[k];
+		}
+
+		template<size_t... I, typename... Columns>
+		void _index_batch(bindex_t *out, size_t count, std::index_sequence<I...>, const Columns*... columns) const
+		{
+			for (size_t start = 0; start < count; start += _batch)
+			{
+				size_t n = std::min(_batch, count - start);
+				(_index_axis<I>(out + start, n, columns + start), ...);
+			}
+		}
+
+		template<size_t... I, typename... Columns>
+		void _coord_batch(const std::array<bindex_t*, dof> &out, size_t count, std::index_sequence<I...>, const Columns*... columns) const
+		{
+			(element<I>().index_batch(out[I], count, columns), ...);
+		}
 		
 	#define ELEMENT_SUBROUTINE(RETURN_T, DECL, EXPR, EXPR_ZERO) \
 		template<size_t I=_n_elems> std::enable_if_t<(I!=0), RETURN_T> DECL {EXPR;} \
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "histogram.hpp"
+
+
+namespace quern
+{
+	/*
+		One changed bin in a histogram delta:  its index and its new count.
+			Counts are absolute, so applying a delta twice is harmless.
+	*/
+	template<typename Count, typename Index = bindex_t>
+	struct histogram_delta_cell
+	{
+		Index index;
+		Count count;
+	};
+
+
+	/*
+		A histogram which records which bins have changed since the last checkpoint.
+			A bitmap marks each changed bin once, and a list holds their indexes in the
+			order they were first touched, so exporting a delta costs O(changed bins)
+			rather than O(bins).  Each add or subtract costs one bit test on top of the
+			count itself.
+
+			clear() and reformat() mark every bin changed, so the next delta is complete.
+			A receiver must share the binning, and be reformatted alongside the sender.
+			Writes through at_index() bypass tracking; call mark() or mark_all() afterward.
+	*/
+	template<class T_Histogram>
+	class histogram_dirty : public T_Histogram
+	{
+	public:
+		using histogram_t    = T_Histogram;
+		using sample_t       = typename histogram_t::sample_t;
+		using count_t        = typename histogram_t::count_t;
+		using index_t        = typename histogram_t::index_t;
+		using coord_t        = typename histogram_t::coord_t;
+		using binning_t      = typename histogram_t::binning_t;
+		using params_t       = typename histogram_t::params_t;
+		using storage_t      = typename histogram_t::storage_t;
+		using allocator_type = typename histogram_t::allocator_type;
+		using delta_cell_t   = histogram_delta_cell<count_t, index_t>;
+
+	public:
+		explicit histogram_dirty()                             : histogram_t()     , _bits(), _list() {_reset();}
+		explicit histogram_dirty(const allocator_type &alloc)    : histogram_t(alloc), _bits(alloc), _list(alloc) {_reset();}
+
+		histogram_dirty(const binning_t &binning, const allocator_type &alloc = allocator_type())
+			: histogram_t(binning, alloc), _bits(alloc), _list(alloc) {_reset();}
+		histogram_dirty(const params_t  &params , const allocator_type &alloc = allocator_type())
+			: histogram_t(params , alloc), _bits(alloc), _list(alloc) {_reset();}
+		histogram_dirty(const binning_t &binning, storage_t &&store)
+			: histogram_t(binning, std::move(store)), _bits(this->get_allocator()), _list(this->get_allocator()) {_reset();}
+
+		// Copies reserve the change list again, since vector copies don't keep capacity.
+		histogram_dirty(const histogram_dirty &o)
+			: histogram_t(o), _bits(o._bits), _list(o._list), _all(o._all) {_list.reserve(size_t(this->bins()));}
+		histogram_dirty(histogram_dirty &&o) = default;
+
+		histogram_dirty &operator=(const histogram_dirty &o)
+		{
+			histogram_t::operator=(o);
+			_bits = o._bits;
+			_list = o._list;
+			_all  = o._all;
+			_list.reserve(size_t(this->bins()));
+			return *this;
+		}
+		histogram_dirty &operator=(histogram_dirty &&o) = default;
+
+
+		/*
+			Add or subtract samples, marking their bins.
+				Returns whether the sample was in binning range.
+				The change list is reserved for every bin, so marking never allocates.
+		*/
+		bool add_at(const index_t   index,  const count_t n = 1) noexcept    {return histogram_t::add_at(index, n) && mark(index);}
+		bool sub_at(const index_t   index,  const count_t n = 1) noexcept    {return histogram_t::sub_at(index, n) && mark(index);}
+		bool add_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return add_at(this->coord_to_index(coord), n);}
+		bool sub_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return sub_at(this->coord_to_index(coord), n);}
+		bool add   (const sample_t &sample, const count_t n = 1)    {return add_at(this->index_for(sample), n);}
+		bool sub   (const sample_t &sample, const count_t n = 1)    {return sub_at(this->index_for(sample), n);}
+
+		size_t add_indexes(const index_t *indexes, size_t count, const count_t n = 1)
+			{size_t hits = 0; for (size_t i = 0; i < count; ++i) hits += add_at(indexes[i], n); return hits;}
+		size_t sub_indexes(const index_t *indexes, size_t count, const count_t n = 1)
+			{size_t hits = 0; for (size_t i = 0; i < count; ++i) hits += sub_at(indexes[i], n); return hits;}
+
+		template<typename... Columns>
+		size_t add_columns(size_t count, const Columns*... columns)
+			{return this->_column_batches(count, [this](const index_t *i, size_t n) {return add_indexes(i, n);}, columns...);}
+		template<typename... Columns>
+		size_t sub_columns(size_t count, const Columns*... columns)
+			{return this->_column_batches(count, [this](const index_t *i, size_t n) {return sub_indexes(i, n);}, columns...);}
+
+		/*
+			Bulk fills mark their bins in a second pass, after the base fill.
+		*/
+		size_t fill_indexes(const index_t *indexes, size_t count, const count_t n = 1, fill_strategy strategy = FILL_AUTO)
+		{
+			size_t hits = histogram_t::fill_indexes(indexes, count, n, strategy);
+			for (size_t i = 0; i < count; ++i) if (this->grid().contains_index(indexes[i])) mark(indexes[i]);
+			return hits;
+		}
+		template<typename... Columns>
+		size_t fill_columns(size_t count, const Columns*... columns)
+		{
+			typename histogram_t::_index_vector indexes(count, index_t(0), this->get_allocator());
+			this->index_for_columns(indexes.data(), count, columns...);
+			return fill_indexes(indexes.data(), count);
+		}
+
+		void clear   (const count_t fill = count_t(0))                          {histogram_t::clear(fill);             mark_all();}
+		void reformat(const binning_t &binning, const count_t fill = count_t(0))    {histogram_t::reformat(binning, fill); _reset(); mark_all();}
+
+
+		/*
+			Mark a bin (in range) or every bin as changed.
+		*/
+		bool mark(index_t index) noexcept
+		{
+			uint64_t &word = _bits[size_t(index) >> 6];
+			uint64_t  bit  = uint64_t(1) << (size_t(index) & 63);
+			if (!(word & bit)) {word |= bit; _list.push_back(index);}
+			return true;
+		}
+		void mark_all() noexcept    {_all = true;}
+
+
+		/*
+			The number of changed bins and their indexes, in first-touched order.
+				After clear() or reformat(), every bin is changed and the list is not used.
+		*/
+		bool           all_dirty()   const noexcept    {return _all;}
+		size_t         dirty_count() const noexcept    {return _all ? size_t(this->bins()) : _list.size();}
+		const index_t *dirty_begin() const noexcept    {return _list.data();}
+		const index_t *dirty_end()   const noexcept    {return _list.data() + _list.size();}
+
+		/*
+			Write a delta_cell_t for each changed bin to <out>, an output iterator.
+				Returns the number of cells written.
+		*/
+		template<typename OutputIterator>
+		size_t export_delta(OutputIterator out) const
+		{
+			if (_all)
+			{
+				for (index_t i = 0; i < this->bins(); ++i) *out++ = delta_cell_t{i, this->count_at(i)};
+				return size_t(this->bins());
+			}
+			for (index_t i : _list) *out++ = delta_cell_t{i, this->count_at(i)};
+			return _list.size();
+		}
+
+		/*
+			Forget all changes; the next delta covers changes from this point.  O(changed bins).
+				Change tracking is not part of the histogram's value, so this is const, and
+				may be called through a tracker's const histogram().
+		*/
+		void checkpoint() const noexcept
+		{
+			if (_all) std::fill(_bits.begin(), _bits.end(), uint64_t(0));
+			else for (index_t i : _list) _bits[size_t(i) >> 6] = 0;
+			_list.clear();
+			_all = false;
+		}
+
+	private:
+		void _reset()
+		{
+			_bits.assign((size_t(this->bins()) + 63) / 64, uint64_t(0));
+			_list.clear();
+			_list.reserve(size_t(this->bins()));
+			_all = false;
+		}
+
+		template<typename T>
+		using _vector = std::vector<T, typename std::allocator_traits<allocator_type>::template rebind_alloc<T>>;
+
+		mutable _vector<uint64_t> _bits;
+		mutable _vector<index_t>  _list;
+		mutable bool              _all = false;
+	};
+
+
+	/*
+		Apply a delta exported by histogram_dirty to a histogram with the same binning.
+			Cells outside the receiver's range are ignored.  Counts are written directly,
+			so a receiving histogram_mode needs recount() and a histogram_tracked needs
+			recalculate() afterward.  Returns the number of cells applied.
+	*/
+	template<class Histogram, typename Count, typename Index>
+	size_t apply_delta(Histogram &histogram, const histogram_delta_cell<Count, Index> *cells, size_t count)
+	{
+		typename Histogram::count_t dummy;
+		size_t applied = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			histogram.at_index(cells[i].index, dummy) = typename Histogram::count_t(cells[i].count);
+			applied += histogram.grid().contains_index(cells[i].index);
+		}
+		return applied;
+	}
+}
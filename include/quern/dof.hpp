@@ -150,7 +150,7 @@ namespace quern
 		template<size_t N>
 		static dof_t <N> &dof (value_t &v)    {return (N < count/2) ? dof_get<N>(v.real()) : dof_get<N-count/2>(v.imag());}
 		template<size_t N>
-		static elem_t<N> &elem(value_t &v)    {return (N==0) ? v.real() : v.imag();}
+		static elem_t<N>  elem(const value_t &v)    {return (N==0) ? v.real() : v.imag();}
 	};
 
 	template<class Head> // Single-element tuple
@@ -181,7 +181,7 @@ namespace quern
 		using elem_t             = typename std::tuple_element<N, value_t>::type;
 		
 		template<size_t N>
-		static dof_t<N>  &dof (value_t &v)    {return _iHead::dof<N>(std::get<0>(v));}
+		static dof_t<N>  &dof (value_t &v)    {return _iHead::template dof<N>(std::get<0>(v));}
 		template<size_t N>
 		static elem_t<N> &elem(value_t &v)    {return std::get<N>(v);}
 	};
@@ -228,7 +228,7 @@ namespace quern
 			template<size_t N> using  dof_t                               = typename std::TYPE_MODIFIER<typename dof_info<T>::template dof_t <N>>::type; \
 			template<size_t N> static dof_t <N> &dof(QUALIFIERS T &v)     {return dof_info<T>::template dof <N>(const_cast<T&>(v));} \
 			template<size_t N> using  elem_t                              = typename std::TYPE_MODIFIER<typename dof_info<T>::template elem_t<N>>::type; \
-			template<size_t N> static elem_t<N> &elem(QUALIFIERS T &v)    {return dof_info<T>::template elem<N>(const_cast<T&>(v));} \
+			template<size_t N> static decltype(auto) elem(QUALIFIERS T &v)    {return dof_info<T>::template elem<N>(const_cast<T&>(v));} \
 		}
 	DOF_Info_CV(const         , , add_const);
 	DOF_Info_CV(      volatile, , add_volatile);
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <array>
+#include <cmath>
 #include <vector>
 #include <type_traits>
 #include <limits>
+#include <utility>
+#include <stdexcept>
+
+#include "grid_storage.hpp"
+#include "trace.hpp"
 
 
 namespace quern
@@ -36,8 +42,9 @@ namespace quern
 
 	/*
 		An N-dimensional grid of values, used in data binning.
+			Cells are kept in a Storage policy (see grid_storage.hpp).
 	*/
-	template<typename Value, size_t Dimensionality>
+	template<typename Value, size_t Dimensionality, class Storage = grid_storage<Value>>
 	class grid : public grid_base
 	{
 	public:
@@ -45,8 +52,11 @@ namespace quern
 		static constexpr size_t N = Dimensionality;
 
 		// Types
-		using value_t = Value;
-		using coord_t = std::array<index_t, N>;
+		using value_t   = Value;
+		using coord_t   = std::array<index_t, N>;
+		using storage_t = Storage;
+
+		using allocator_type = typename storage_t::allocator_type;
 		//    index_t
 
 		template<typename T_Frac>
@@ -62,7 +72,7 @@ namespace quern
 	private:
 		// Implementation
 		friend class const_iterator;
-		using _store_t = std::vector<value_t>;
+		using _store_t = storage_t;
 
 	public:
 		
@@ -85,11 +95,11 @@ namespace quern
 		{
 		protected:
 			const grid *_g;
-			const value_t  *_i;
-			coord_t         _c;
+			index_t     _i;
+			coord_t     _c;
 
 			friend class grid;
-			const_iterator(const grid *g, const value_t *i, const coord_t &c)
+			const_iterator(const grid *g, index_t i, const coord_t &c)
 				: _g(g), _i(i), _c(c) {}
 
 			void _inc()
@@ -114,17 +124,17 @@ namespace quern
 			}
 
 		public:
-			const_iterator()                                     : _g(nullptr), _i(nullptr), _c{} {}
-			const_iterator(const grid &g)                    : _g(&g), _i( g._store.data()), _c{} {}
-			const_iterator(const grid &g, iterator_end_t)    : _g(&g), _i(&g._store.back()+1), _c{}
+			const_iterator()                                 : _g(nullptr), _i(0), _c{} {}
+			const_iterator(const grid &g)                    : _g(&g), _i(0), _c{} {}
+			const_iterator(const grid &g, iterator_end_t)    : _g(&g), _i(g.total_size()), _c{}
 				{_c[dimensionality-1] = _g->dimensions()[dimensionality-1];}
 
 			// Dereference value
-			const value_t &operator* () const    {return *_i;}
-			const value_t *operator->() const    {return  _i;}
+			const value_t &operator* () const    {return  _g->_store[_i];}
+			const value_t *operator->() const    {return &_g->_store[_i];}
 
 			// Get index or coordinate of this bin
-			index_t        index () const    {return _i - _g->_store.data();}
+			index_t        index () const    {return _i;}
 			const coord_t &coord () const    {return _c;}
 
 			// Comparison
@@ -147,7 +157,7 @@ namespace quern
 		{
 		protected:
 			friend class grid;
-			iterator(grid *g, const value_t *i, const coord_t &c)   : const_iterator(g,i,c) {}
+			iterator(grid *g, index_t i, const coord_t &c)   : const_iterator(g,i,c) {}
 
 		public:
 			iterator()                               : const_iterator()                {}
@@ -155,8 +165,8 @@ namespace quern
 			iterator(grid &g, iterator_end_t)    : const_iterator(g, iterator_end) {}
 
 			// Access mutable key
-			value_type &operator* () const    {return const_cast<value_type&>(*const_iterator::_i);}
-			value_type *operator->() const    {return const_cast<value_type*>( const_iterator::_i);}
+			value_type &operator* () const    {return  const_cast<grid*>(this->_g)->_store[this->_i];}
+			value_type *operator->() const    {return &const_cast<grid*>(this->_g)->_store[this->_i];}
 
 			// Arithmetic
 			iterator  operator++(int)                       {auto r=*this; this->_inc(); return r;}
@@ -172,29 +182,44 @@ namespace quern
 				A reformat will be necessary to get use out if it.
 		*/
 		grid() : _dims{} {}
+		explicit grid(const allocator_type &alloc) : _dims{}, _store(alloc) {}
 
 		/*
 			Set up a uniform grid based on dimensions and initial value.
 		*/
-		grid(const coord_t &dimensions, const value_t &fill = value_t{})
-			: _dims(dimensions) {_store.resize(TotalItems(dimensions), fill);}
+		grid(const coord_t &dimensions, const value_t &fill = value_t{}, const allocator_type &alloc = allocator_type())
+			: _dims(dimensions), _store(alloc) {_store.assign(TotalItems(dimensions), fill);}
+
+		/*
+			Adopt existing storage (such as a view of mapped memory), keeping its contents.
+				Throws std::length_error if the storage size doesn't match the dimensions.
+		*/
+		grid(const coord_t &dimensions, storage_t &&store)
+			: _dims(dimensions), _store(std::move(store))
+		{
+			if (_store.size() != size_t(TotalItems(dimensions)))
+				throw std::length_error("grid storage does not match dimensions");
+		}
 
 		/*
 			Clear the grid to the given fill-value.
+				O(1) with generation-tagged storage.
 		*/
 		void clear(const value_t &fill = value_t{})
 		{
-			for (auto &i : _store) i = fill;
+			QUERN_TRACE_SCOPE("grid::clear");
+			_store.fill(fill);
 		}
 
 		/*
 			Reformat the Grid to a new size, erasing all data.
+				The storage policy may reuse its allocation when the size is unchanged.
 		*/
 		void reformat(const coord_t &dimensions, const value_t &fill = value_t{})
 		{
+			QUERN_TRACE_SCOPE("grid::reformat");
 			_dims = dimensions;
-			_store.clear();
-			_store.resize(TotalItems(dimensions), fill);
+			_store.assign(TotalItems(dimensions), fill);
 		}
 
 		/*
@@ -216,7 +241,9 @@ namespace quern
 		/*
 			Access the dimensions
 		*/
-		size_t           total_size() const    {return _store.size();}
+		size_t           total_size()    const    {return _store.size();}
+		allocator_type   get_allocator() const    {return _store.get_allocator();}
+		const storage_t &storage()       const    {return _store;}
 		const coord_t   &dimensions() const    {return _dims;}
 		
 		/*
@@ -231,10 +258,10 @@ namespace quern
 		/*
 			Get an iterator pointing to the given coordinate or index.
 		*/
-		const_iterator to      (const coord_t &coord) const    {return const_iterator(this, _store.data()+coord_to_index(coord, _store.size()), coord);}
-		/* */ iterator to      (const coord_t &coord)          {return       iterator(this, _store.data()+coord_to_index(coord, _store.size()), coord);}
-		const_iterator to_index(const index_t  index) const    {return contains_index(index) ? const_iterator(this, _store.data()+index, index_to_coord(index)) : end();}
-		/* */ iterator to_index(const index_t  index)          {return contains_index(index) ?       iterator(this, _store.data()+index, index_to_coord(index)) : end();}
+		const_iterator to      (const coord_t &coord) const    {return const_iterator(this, coord_to_index(coord, _store.size()), coord);}
+		/* */ iterator to      (const coord_t &coord)          {return       iterator(this, coord_to_index(coord, _store.size()), coord);}
+		const_iterator to_index(const index_t  index) const    {return contains_index(index) ? const_iterator(this, index, index_to_coord(index)) : end();}
+		/* */ iterator to_index(const index_t  index)          {return contains_index(index) ?       iterator(this, index, index_to_coord(index)) : end();}
 
 		/*
 			Access elements at the given coordinate or index.
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+
+
+namespace quern
+{
+	/*
+		Storage policies for grid<Value, N, Storage>.
+			A storage policy owns the cells of a grid and provides:
+
+			allocator_type  -- allocator used for cells, also accepted by the constructor
+			size()          -- number of cells
+			assign(n, fill) -- resize to n cells, all reading as fill (used by reformat)
+			fill(value)     -- set every cell to value (used by clear)
+			operator[](i)   -- const access for reading, mutable access for writing
+	*/
+
+
+	/*
+		Dense storage:  a contiguous array of cells.
+			Reformatting to a size within capacity reuses the allocation.
+	*/
+	template<typename Value, typename Alloc = std::allocator<Value>>
+	class grid_storage
+	{
+	public:
+		using value_t        = Value;
+		using allocator_type = Alloc;
+
+		grid_storage() {}
+		explicit grid_storage(const allocator_type &alloc)    : _cells(alloc) {}
+
+		allocator_type get_allocator() const    {return _cells.get_allocator();}
+
+		size_t size() const noexcept    {return _cells.size();}
+
+		void assign(size_t n, const value_t &fill)    {_cells.assign(n, fill);}
+		void fill  (const value_t &fill)              {std::fill(_cells.begin(), _cells.end(), fill);}
+
+		const value_t &operator[](size_t i) const    {return _cells[i];}
+		value_t       &operator[](size_t i)          {return _cells[i];}
+
+	private:
+		std::vector<value_t, allocator_type> _cells;
+	};
+
+
+	/*
+		Generation-tagged storage, for O(1) clearing (eg, tumbling windows over large grids).
+			Cells are grouped into blocks of 2^BlockBits, each tagged with the generation
+			in which it was last written.  fill() only advances the generation counter;
+			stale blocks read as the fill value and are re-filled on their first write.
+			assign() to the current size reuses the allocation and is likewise O(1).
+
+			Every access, read or write, costs one tag comparison; this includes each
+			bin read while a tracked quantile walks the histogram.  BlockBits = 0 tags
+			each cell individually.
+	*/
+	template<typename Value, size_t BlockBits = 6, typename Alloc = std::allocator<Value>>
+	class grid_storage_generational
+	{
+	public:
+		using value_t        = Value;
+		using generation_t   = uint32_t;
+		using allocator_type = Alloc;
+
+		static constexpr size_t block_bits = BlockBits;
+		static constexpr size_t block_size = size_t(1) << BlockBits;
+
+		grid_storage_generational() {}
+		explicit grid_storage_generational(const allocator_type &alloc)    : _cells(alloc), _tags(alloc) {}
+
+		allocator_type get_allocator() const    {return _cells.get_allocator();}
+
+		size_t size() const noexcept    {return _cells.size();}
+
+		// The current generation; advances with every fill().
+		generation_t generation() const noexcept    {return _generation;}
+
+		void assign(size_t n, const value_t &fill)
+		{
+			if (n == _cells.size()) {this->fill(fill); return;}
+
+			_fill = fill;
+			_cells.assign(n, fill);
+			_tags.assign((n + block_size - 1) >> block_bits, _generation);
+		}
+
+		void fill(const value_t &fill)
+		{
+			_fill = fill;
+			if (++_generation == 0)
+			{
+				// Counter wrapped around:  retag everything as stale.
+				std::fill(_tags.begin(), _tags.end(), generation_t(0));
+				_generation = 1;
+			}
+		}
+
+		const value_t &operator[](size_t i) const
+		{
+			return (_tags[i >> block_bits] == _generation) ? _cells[i] : _fill;
+		}
+		value_t &operator[](size_t i)
+		{
+			size_t block = i >> block_bits;
+			if (_tags[block] != _generation) _renew(block);
+			return _cells[i];
+		}
+
+	private:
+		void _renew(size_t block)
+		{
+			size_t first = block << block_bits, last = std::min(first + block_size, _cells.size());
+			std::fill(_cells.begin() + first, _cells.begin() + last, _fill);
+			_tags[block] = _generation;
+		}
+
+		using _tag_alloc_t = typename std::allocator_traits<allocator_type>::template rebind_alloc<generation_t>;
+
+		std::vector<value_t, allocator_type>    _cells;
+		std::vector<generation_t, _tag_alloc_t> _tags;
+		generation_t                            _generation = 1;
+		value_t                                 _fill       = value_t{};
+	};
+
+
+	/*
+		Copy-on-write storage, for cheap point-in-time snapshots of large grids.
+			Cells are grouped into blocks of 2^BlockBits, reference-counted and shared
+			between copies, under a block table which is itself shared.  Copying the
+			storage (and so the grid or histogram over it) is O(1).  The first write
+			after a copy clones the block table, O(blocks) pointers, and each write to a
+			shared block clones that block, so a snapshot costs memory in proportion to
+			the blocks written since.
+
+			Reads cost two extra indirections; writes also check both reference counts.
+			A reference from a mutable operator[] must not be held across a copy.  As
+			with other containers, copying must not race with writes to the source.
+	*/
+	template<typename Value, size_t BlockBits = 10, typename Alloc = std::allocator<Value>>
+	class grid_storage_cow
+	{
+	public:
+		using value_t        = Value;
+		using allocator_type = Alloc;
+
+		static constexpr size_t block_bits = BlockBits;
+		static constexpr size_t block_size = size_t(1) << BlockBits;
+
+	private:
+		using _block_t       = std::array<value_t, block_size>;
+		using _block_ptr     = std::shared_ptr<_block_t>;
+		using _block_alloc_t = typename std::allocator_traits<allocator_type>::template rebind_alloc<_block_t>;
+		using _table_t       = std::vector<_block_ptr, typename std::allocator_traits<allocator_type>::template rebind_alloc<_block_ptr>>;
+		using _table_alloc_t = typename std::allocator_traits<allocator_type>::template rebind_alloc<_table_t>;
+
+	public:
+		grid_storage_cow() {}
+		explicit grid_storage_cow(const allocator_type &alloc)    : _alloc(alloc) {}
+
+		allocator_type get_allocator() const    {return _alloc;}
+
+		size_t size() const noexcept    {return _size;}
+
+		void assign(size_t n, const value_t &fill)
+		{
+			_size  = n;
+			_table = std::allocate_shared<_table_t>(_table_alloc_t(_alloc), (n + block_size - 1) >> block_bits, _block_ptr(), _alloc);
+			for (auto &block : *_table) block = _new_block(fill);
+		}
+
+		void fill(const value_t &fill)
+		{
+			if (!_table) return;
+			_own_table();
+			for (auto &block : *_table)
+			{
+				if (block.use_count() == 1) block->fill(fill);
+				else                        block = _new_block(fill);
+			}
+		}
+
+		const value_t &operator[](size_t i) const
+		{
+			return (*(*_table)[i >> block_bits])[i & (block_size - 1)];
+		}
+		value_t &operator[](size_t i)
+		{
+			_own_table();
+			_block_ptr &block = (*_table)[i >> block_bits];
+			if (block.use_count() != 1) block = std::allocate_shared<_block_t>(_block_alloc_t(_alloc), *block);
+			return (*block)[i & (block_size - 1)];
+		}
+
+		/*
+			The number of blocks shared with a copy (for diagnostics).
+		*/
+		size_t shared_blocks() const noexcept
+		{
+			if (!_table)                return 0;
+			if (_table.use_count() > 1) return _table->size();
+			size_t n = 0;
+			for (auto &block : *_table) n += (block.use_count() > 1);
+			return n;
+		}
+
+	private:
+		_block_ptr _new_block(const value_t &fill)
+		{
+			_block_ptr block = std::allocate_shared<_block_t>(_block_alloc_t(_alloc));
+			block->fill(fill);
+			return block;
+		}
+
+		void _own_table()
+		{
+			if (_table.use_count() != 1) _table = std::allocate_shared<_table_t>(_table_alloc_t(_alloc), *_table);
+		}
+
+		allocator_type            _alloc = allocator_type();
+		std::shared_ptr<_table_t> _table;
+		size_t                    _size  = 0;
+	};
+
+
+	/*
+		Non-owning storage over an external array of cells (eg, a memory-mapped file).
+			The array must outlive the grid.  A view cannot be resized:  assign() to
+			any other size throws std::length_error.  Construct the grid by adopting
+			a view to use its existing contents.
+	*/
+	template<typename Value>
+	class grid_storage_view
+	{
+	public:
+		using value_t        = Value;
+		using allocator_type = std::allocator<Value>; // Unused; views never allocate.
+
+		grid_storage_view()                                   : _cells(nullptr), _size(0) {}
+		explicit grid_storage_view(const allocator_type &)    : _cells(nullptr), _size(0) {}
+		grid_storage_view(value_t *cells, size_t size)        : _cells(cells), _size(size) {}
+
+		allocator_type get_allocator() const    {return {};}
+
+		size_t size() const noexcept    {return _size;}
+
+		void assign(size_t n, const value_t &fill)
+		{
+			if (n != _size) throw std::length_error("grid_storage_view cannot be resized");
+			this->fill(fill);
+		}
+		void fill(const value_t &fill)    {std::fill(_cells, _cells + _size, fill);}
+
+		const value_t &operator[](size_t i) const    {return _cells[i];}
+		value_t       &operator[](size_t i)          {return _cells[i];}
+
+		const value_t *data() const noexcept    {return _cells;}
+		value_t       *data()       noexcept    {return _cells;}
+
+	private:
+		value_t *_cells;
+		size_t   _size;
+	};
+}
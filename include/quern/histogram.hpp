@@ -1,10 +1,23 @@
 #pragma once
 
 
+#include <vector>
+#include <memory>
+#include <algorithm>
+
 #include "quantile.hpp"
 #include "bin_table.hpp"
 
 
+/*
+	Per-core L2 size, used to pick a bulk fill strategy (see histogram::fill_indexes).
+		Define before including any quern header to tune for a machine.
+*/
+#ifndef QUERN_CACHE_L2_BYTES
+	#define QUERN_CACHE_L2_BYTES (size_t(1) << 20)
+#endif
+
+
 namespace quern
 {
 	/*
@@ -13,6 +26,17 @@ namespace quern
 	enum EraseBinnedSamples_t {EraseBinnedSamples};
 
 
+	/*
+		Strategies for filling a histogram from a large batch of indexes.
+			FILL_DIRECT     -- increment bins in input order; best while the grid fits in L2
+			FILL_PREFETCH   -- as direct, prefetching bins a few samples ahead
+			FILL_PARTITION  -- radix-partition the indexes into L2-sized ranges of bins,
+			                   then accumulate one range at a time
+			FILL_AUTO       -- choose from the grid size, the batch size and the L2 size (see choose_fill)
+	*/
+	enum fill_strategy {FILL_AUTO, FILL_DIRECT, FILL_PREFETCH, FILL_PARTITION};
+
+
 	/*
 		A collection of bins quantifying the number of samples in each bin's range.
 			"Count" is flexible; float or signed values are permissible.
@@ -21,12 +45,13 @@ namespace quern
 	template<
 		typename Sample,
 		typename Count = uint32_t,
-		typename Binning = binning<Sample> >
+		typename Binning = binning<Sample>,
+		typename Storage = grid_storage<Count> >
 	class histogram :
-		public bin_table<Sample, Count, Binning>
+		public bin_table<Sample, Count, Binning, Storage>
 	{
 	public:
-		using table_t = bin_table<Sample, Count, Binning>;
+		using table_t = bin_table<Sample, Count, Binning, Storage>;
 
 		using sample_t       = Sample;
 		using count_t        = Count;
@@ -34,6 +59,8 @@ namespace quern
 		using coord_t        = typename table_t::coord_t;
 		using binning_t      = typename table_t::binning_t;
 		using params_t       = typename binning_t::params_t;
+		using storage_t      = typename table_t::storage_t;
+		using allocator_type = typename table_t::allocator_type;
 		using iterator       = typename table_t::iterator;
 		using const_iterator = typename table_t::const_iterator;
 
@@ -47,27 +74,106 @@ namespace quern
 		/*
 			Default constructor.  We won't be able to add samples...
 		*/
-		explicit histogram()    : bin_table<Sample, Count, Binning>() {}
+		explicit histogram()                             : table_t() {}
+		explicit histogram(const allocator_type &alloc)    : table_t(alloc) {}
 
 		/*
 			Set up empty bins based on an array of binning rules.
 		*/
-		histogram(const binning_t &binning)    : table_t(binning, count_t(0)) {}
-		histogram(const params_t  &params )    : table_t(params , count_t(0)) {}
+		histogram(const binning_t &binning, const allocator_type &alloc = allocator_type())    : table_t(binning, count_t(0), alloc) {}
+		histogram(const params_t  &params , const allocator_type &alloc = allocator_type())    : table_t(params , count_t(0), alloc) {}
+
+		/*
+			Set up bins over existing storage, keeping its counts.
+		*/
+		histogram(const binning_t &binning, storage_t &&store)    : table_t(binning, std::move(store)) {}
 
 
 		/*
 			Add or subtract samples.
 				Returns whether the sample was in binning range.
 		*/
-		void add_at(const index_t   index,  const count_t n = 1) noexcept    {count_t dummy; this->at_index(index, dummy) += n;}
-		void sub_at(const index_t   index,  const count_t n = 1) noexcept    {count_t dummy; this->at_index(index, dummy) -= n;}
-		void add_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return add_at(this->coord_to_index(coord), n);}
-		void sub_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return sub_at(this->coord_to_index(coord), n);}
-		void add   (const sample_t &sample, const count_t n = 1) noexcept    {return add_at(this->index_for(sample), n);}
-		void sub   (const sample_t &sample, const count_t n = 1) noexcept    {return sub_at(this->index_for(sample), n);}
+		bool add_at(const index_t   index,  const count_t n = 1) noexcept    {count_t dummy; this->at_index(index, dummy) += n; return this->grid().contains_index(index);}
+		bool sub_at(const index_t   index,  const count_t n = 1) noexcept    {count_t dummy; this->at_index(index, dummy) -= n; return this->grid().contains_index(index);}
+		bool add_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return add_at(this->coord_to_index(coord), n);}
+		bool sub_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return sub_at(this->coord_to_index(coord), n);}
+		bool add   (const sample_t &sample, const count_t n = 1) noexcept    {return add_at(this->index_for(sample), n);}
+		bool sub   (const sample_t &sample, const count_t n = 1) noexcept    {return sub_at(this->index_for(sample), n);}
 		
 
+		/*
+			Add or subtract many samples by index, skipping BIN_REJECT.
+				Returns the number of indexes in range.
+		*/
+		size_t add_indexes(const index_t *indexes, size_t count, const count_t n = 1) noexcept
+		{
+			size_t hits = 0;
+			for (size_t i = 0; i < count; ++i) hits += add_at(indexes[i], n);
+			return hits;
+		}
+		size_t sub_indexes(const index_t *indexes, size_t count, const count_t n = 1) noexcept
+		{
+			size_t hits = 0;
+			for (size_t i = 0; i < count; ++i) hits += sub_at(indexes[i], n);
+			return hits;
+		}
+
+		/*
+			Add or subtract samples given as columns, one per element of the sample type in
+				dof element order (eg, x, y and channel arrays for std::tuple<float,float,Channel>).
+				Columns are binned in batches without building sample values.
+				Returns the number of samples in range.
+		*/
+		template<typename... Columns>
+		size_t add_columns(size_t count, const Columns*... columns)
+			{return _column_batches(count, [this](const index_t *i, size_t n) {return add_indexes(i, n);}, columns...);}
+		template<typename... Columns>
+		size_t sub_columns(size_t count, const Columns*... columns)
+			{return _column_batches(count, [this](const index_t *i, size_t n) {return sub_indexes(i, n);}, columns...);}
+
+		/*
+			Add every index in a large batch, skipping BIN_REJECT, using a strategy suited to
+				the grid's size relative to cache.  Counts are as for add_indexes.
+				Returns the number of indexes in range.
+		*/
+		size_t fill_indexes(const index_t *indexes, size_t count, const count_t n = 1, fill_strategy strategy = FILL_AUTO)
+		{
+			QUERN_TRACE_SCOPE("histogram::fill_indexes");
+			if (strategy == FILL_AUTO) strategy = choose_fill(count);
+			switch (strategy)
+			{
+			case FILL_PARTITION: return _fill_partitioned(indexes, count, n);
+			case FILL_PREFETCH:  return _fill_prefetched (indexes, count, n);
+			default:             return add_indexes      (indexes, count, n);
+			}
+		}
+
+		/*
+			Bin and add a large batch of samples given as columns (as for add_columns).
+				Binning the whole batch first lets fill_indexes reorder the increments.
+		*/
+		template<typename... Columns>
+		size_t fill_columns(size_t count, const Columns*... columns)
+		{
+			_index_vector indexes(count, index_t(0), this->get_allocator());
+			this->index_for_columns(indexes.data(), count, columns...);
+			return fill_indexes(indexes.data(), count);
+		}
+
+		/*
+			The strategy FILL_AUTO picks for a batch of <count> indexes.
+				Grids within L2 fill directly.  Beyond that, partitioning pays only once each
+				partition receives several samples per cache line, so it is chosen for batches
+				of at least four samples per bin over grids of several L2s; otherwise prefetch.
+		*/
+		fill_strategy choose_fill(size_t count) const noexcept
+		{
+			size_t bins = size_t(this->bins()), grid_bytes = bins * sizeof(count_t);
+			if (grid_bytes <= QUERN_CACHE_L2_BYTES) return FILL_DIRECT;
+			if (grid_bytes > 4 * QUERN_CACHE_L2_BYTES && bins <= _partition_chunk && count >= 4 * bins) return FILL_PARTITION;
+			return FILL_PREFETCH;
+		}
+
 		/*
 			Access or increment the count at the given indices.
 		*/
@@ -81,9 +187,91 @@ namespace quern
 			Calculate the total population by iterating over the histogram.
 				Use tracked_histogram for inexpensive access to the total.
 		*/
-		count_t calc_population() const noexcept    {count_t n=0; for (auto &c:this->grid()) n+=c; return n;}
+		count_t calc_population() const noexcept
+		{
+			QUERN_TRACE_SCOPE("histogram::calc_population");
+			count_t n=0; for (auto &c:this->grid()) n+=c; return n;
+		}
 
 		
+	protected:
+		using _index_vector = std::vector<index_t, typename std::allocator_traits<allocator_type>::template rebind_alloc<index_t>>;
+
+		static constexpr size_t _prefetch_distance = 16;
+		static constexpr size_t _partition_max     = 1024;
+		static constexpr size_t _partition_chunk   = size_t(1) << 22;
+
+		// Bins per partition, as a power of two, sized to half of L2 and limited to _partition_max partitions.
+		unsigned _partition_shift() const noexcept
+		{
+			unsigned shift = 0;
+			while ((sizeof(count_t) << (shift + 1)) <= QUERN_CACHE_L2_BYTES / 2) ++shift;
+			while ((size_t(this->bins()) >> shift) >= _partition_max) ++shift;
+			return shift;
+		}
+		size_t _partitions() const noexcept    {return (size_t(this->bins()) >> _partition_shift()) + 1;}
+
+		size_t _fill_prefetched(const index_t *indexes, size_t count, const count_t n) noexcept
+		{
+			count_t dummy;
+			size_t  hits = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+#if defined(__GNUC__) || defined(__clang__)
+				if (i + _prefetch_distance < count)
+					__builtin_prefetch(&this->at_index(indexes[i + _prefetch_distance], dummy), 1);
+#endif
+				hits += add_at(indexes[i], n);
+			}
+			return hits;
+		}
+
+		// Counting sort each chunk by partition (dropping rejected indexes), then accumulate in partition order.
+		size_t _fill_partitioned(const index_t *indexes, size_t count, const count_t n)
+		{
+			const unsigned shift = _partition_shift();
+			const size_t   chunk = std::min(count, _partition_chunk);
+			std::vector<size_t> offsets(_partitions() + 1);
+			_index_vector       sorted(chunk, index_t(0), this->get_allocator());
+			count_t             dummy;
+			size_t              hits = 0;
+
+			for (size_t start = 0; start < count; start += chunk)
+			{
+				const index_t *in  = indexes + start;
+				const size_t   end = std::min(chunk, count - start);
+
+				std::fill(offsets.begin(), offsets.end(), size_t(0));
+				for (size_t i = 0; i < end; ++i)
+					if (this->grid().contains_index(in[i])) ++offsets[(size_t(in[i]) >> shift) + 1];
+				for (size_t p = 1; p < offsets.size(); ++p) offsets[p] += offsets[p - 1];
+
+				const size_t sorted_end = offsets.back();
+				for (size_t i = 0; i < end; ++i)
+					if (this->grid().contains_index(in[i])) sorted[offsets[size_t(in[i]) >> shift]++] = in[i];
+
+				for (size_t i = 0; i < sorted_end; ++i) this->at_index(sorted[i], dummy) += n;
+				hits += sorted_end;
+			}
+			return hits;
+		}
+
+		// Bin columns in stack-sized batches, passing each batch of indexes to func.  Sums func's results.
+		template<typename Func, typename... Columns>
+		size_t _column_batches(size_t count, Func &&func, const Columns*... columns) const
+		{
+			static constexpr size_t batch = 256;
+			index_t indexes[batch];
+			size_t  hits = 0;
+			for (size_t start = 0; start < count; start += batch)
+			{
+				size_t n = std::min(batch, count - start);
+				this->index_for_columns(indexes, n, (columns + start)...);
+				hits += func(static_cast<const index_t*>(indexes), n);
+			}
+			return hits;
+		}
+
 #if 0
 	public:
 		/*
@@ -120,14 +308,16 @@ namespace quern
 	/*
 		Find a quantile in the given histogram.
 	*/
-	template<typename QuantileInt, typename Sample, typename Count, typename Binning>
+	template<typename QuantileInt, typename Sample, typename Count, typename Binning, typename Storage>
 	quantile_range<bindex_t> find_quantile_indexes(
-		const histogram<Sample, Count, Binning> &histogram,
+		const histogram<Sample, Count, Binning, Storage> &histogram,
 		const quantile_fraction<QuantileInt>      quantile)
 	{
-		static_assert(quern::histogram<Sample,Count,Binning>::dimensionality == 1,
+		static_assert(quern::histogram<Sample,Count,Binning,Storage>::dimensionality == 1,
 			"find_quantile requires 1D histogram.");
 
+		QUERN_TRACE_SCOPE("find_quantile_indexes");
+
 		Count numerator = quantile.num, denominator = quantile.den;
 
 		Count quota = histogram.calc_population() * numerator, leq = histogram.count_at(0)*denominator;
@@ -160,9 +350,9 @@ namespace quern
 #endif
 	}
 
-	template<typename QuantileInt, typename Sample, typename Count, typename Binning>
+	template<typename QuantileInt, typename Sample, typename Count, typename Binning, typename Storage>
 	quantile_range<Sample> find_quantile(
-		const histogram<Sample, Count, Binning> &histogram,
+		const histogram<Sample, Count, Binning, Storage> &histogram,
 		const quantile_fraction<QuantileInt>      quantile)
 	{
 		auto indexes = find_quantile_indexes(histogram, quantile);
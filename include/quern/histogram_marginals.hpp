@@ -0,0 +1,202 @@
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "binning_multi.hpp"
+#include "histogram_tracked.hpp"
+
+
+namespace quern
+{
+	/*
+		A multivariate histogram which tracks quantiles of each axis independently.
+
+		Samples are binned once, into the joint N-dimensional histogram.  The resulting
+			coordinate also updates a 1-D marginal histogram per axis, each of which is a
+			histogram_tracked, so per-axis quantiles cost no more binning than the joint
+			histogram itself.  A sample rejected on any axis is rejected on all of them,
+			so every marginal has the same population as the joint histogram.
+
+		T_HistogramBase  -- an N-dimensional histogram
+		T_Instrument     -- instrumentation policy for each marginal tracker (see instrument.hpp)
+	*/
+	template<
+		class T_HistogramBase,
+		class T_Instrument = tracked_instrument_none>
+	class histogram_marginals
+	{
+	public:
+		using histogram_t  = T_HistogramBase;
+		using sample_t     = typename histogram_t::sample_t;
+		using count_t      = typename histogram_t::count_t;
+		using index_t      = typename histogram_t::index_t;
+		using coord_t      = typename histogram_t::coord_t;
+		using binning_t    = typename histogram_t::binning_t;
+		using params_t     = typename histogram_t::params_t;
+		using storage_t    = typename histogram_t::storage_t;
+		using instrument_t = T_Instrument;
+
+		using allocator_type = typename histogram_t::allocator_type;
+
+		static constexpr size_t dimensionality = histogram_t::dimensionality;
+
+		static_assert(dimensionality == dof_elems<sample_t>,
+			"histogram_marginals requires one degree of freedom per sample element");
+
+		/*
+			The sample element and marginal tracker types for axis I.
+		*/
+		template<size_t I> using element_t  = typename std::tuple_element<I, typename dof_info<sample_t>::tuple_t>::type;
+		template<size_t I> using marginal_t = histogram_tracked<
+			histogram<element_t<I>, count_t, binning<element_t<I>>, storage_t>, instrument_t>;
+
+	private:
+		template<typename Seq> struct _marginals_for;
+		template<size_t... I>  struct _marginals_for<std::index_sequence<I...>>    {using type = std::tuple<marginal_t<I>...>;};
+
+		using _axes      = std::make_index_sequence<dimensionality>;
+		using marginals_t = typename _marginals_for<_axes>::type;
+
+		template<typename T>
+		using _not_allocator = std::enable_if_t<!std::is_convertible<T, allocator_type>::value>;
+
+	public:
+		/*
+			Default constructor.  This empty histogram will not accept samples.
+		*/
+		explicit histogram_marginals()    : _histogram(), _population(0) {}
+
+		/*
+			Set up empty bins based on binning rules, with no tracked quantiles.
+		*/
+		histogram_marginals(const binning_t &binning, const allocator_type &alloc = allocator_type())
+			: _histogram(binning, alloc), _population(0), _marginals(_make_marginals(binning, alloc, _axes{})) {}
+		histogram_marginals(const params_t  &params , const allocator_type &alloc = allocator_type())
+			: histogram_marginals(binning_t(params), alloc) {}
+
+		/*
+			As above, tracking the same quantiles on every axis.
+		*/
+		template<typename QuantileList, typename = _not_allocator<QuantileList>>
+		histogram_marginals(const binning_t &binning, const QuantileList &quantiles, const allocator_type &alloc = allocator_type())
+			: histogram_marginals(binning, alloc) {add_quantiles(quantiles);}
+		template<typename QuantileList, typename = _not_allocator<QuantileList>>
+		histogram_marginals(const params_t  &params , const QuantileList &quantiles, const allocator_type &alloc = allocator_type())
+			: histogram_marginals(binning_t(params), alloc) {add_quantiles(quantiles);}
+
+
+		/*
+			Track additional quantiles on every axis, or on axis I only.
+		*/
+		template<typename QuantileList>
+		void add_quantiles(const QuantileList &quantiles)
+		{
+			_each([&](auto, auto &m) {m.add_quantiles(quantiles);});
+		}
+		template<size_t I, typename QuantileList>
+		void add_quantiles(const QuantileList &quantiles)    {std::get<I>(_marginals).add_quantiles(quantiles);}
+
+		/*
+			Recount population and rescan all quantiles.
+		*/
+		void recalculate()
+		{
+			_population = _histogram.calc_population();
+			_each([&](auto, auto &m) {m.recalculate();});
+		}
+
+		/*
+			Remove all samples.
+		*/
+		void clear()
+		{
+			_histogram.clear(count_t(0));
+			_population = 0;
+			_each([&](auto, auto &m) {m.clear();});
+		}
+
+
+		/*
+			Access the joint histogram, and the marginal tracker, histogram and quantiles for axis I.
+		*/
+		const histogram_t &histogram()  const noexcept    {return _histogram;}
+		const count_t      population() const noexcept    {return _population;}
+
+		template<size_t I> const marginal_t<I> &marginal() const noexcept    {return std::get<I>(_marginals);}
+		template<size_t I> const auto &marginal_histogram() const noexcept   {return marginal<I>().histogram();}
+		template<size_t I> const auto &quantiles()          const noexcept   {return marginal<I>().quantiles();}
+
+		template<size_t I> instrument_t &instrument() noexcept    {return std::get<I>(_marginals).instrument();}
+
+
+		/*
+			Insert or remove a sample.
+		*/
+		void insert(const sample_t &new_sample)    {insert_at_coord(_histogram.coord_for(new_sample));}
+		void remove(const sample_t &old_sample)    {remove_at_coord(_histogram.coord_for(old_sample));}
+
+		/*
+			Replace a sample.  Each axis only adjusts quantiles its own coordinate affects.
+		*/
+		void replace(const sample_t &new_sample, const sample_t &old_sample)
+		{
+			replace_at_coords(_histogram.coord_for(new_sample), _histogram.coord_for(old_sample));
+		}
+
+		void insert_at_coord(const coord_t &c)
+		{
+			if (!_accept(c)) {_each([&](auto, auto &m) {m.instrument().reject();}); return;}
+			_histogram.add_at(c);
+			++_population;
+			_each([&](auto I, auto &m) {m.insert_at_index(c[I]);});
+		}
+
+		void remove_at_coord(const coord_t &c)
+		{
+			if (!_accept(c)) {_each([&](auto, auto &m) {m.instrument().reject();}); return;}
+			_histogram.sub_at(c);
+			--_population;
+			_each([&](auto I, auto &m) {m.remove_at_index(c[I]);});
+		}
+
+		void replace_at_coords(const coord_t &new_c, const coord_t &old_c)
+		{
+			if (!_accept(new_c)) {remove_at_coord(old_c); return;}
+			if (!_accept(old_c)) {insert_at_coord(new_c); return;}
+
+			_histogram.add_at(new_c);
+			_histogram.sub_at(old_c);
+			_each([&](auto I, auto &m) {m.replace_at_indexes(new_c[I], old_c[I]);});
+		}
+
+
+	private:
+		template<size_t... I>
+		static marginals_t _make_marginals(const binning_t &binning, const allocator_type &alloc, std::index_sequence<I...>)
+		{
+			return marginals_t(marginal_t<I>(binning.template element<I>(), alloc)...);
+		}
+
+		// Call func(std::integral_constant<size_t, I>, marginal) for each axis I.
+		template<typename Func>
+		void _each(Func &&func)    {_each(func, _axes{});}
+		template<typename Func, size_t... I>
+		void _each(Func &func, std::index_sequence<I...>)
+		{
+			(func(std::integral_constant<size_t, I>{}, std::get<I>(_marginals)), ...);
+		}
+
+		bool _accept(const coord_t &c) const
+		{
+			auto size = _histogram.grid_size();
+			for (size_t i = 0; i < dimensionality; ++i) if (c[i] < 0 || c[i] >= size[i]) return false;
+			return true;
+		}
+
+		histogram_t _histogram;
+		count_t     _population;
+		marginals_t _marginals;
+	};
+}
@@ -2,10 +2,16 @@
 
 #include <exception>
 #include <utility>
+#include <algorithm>
 #include <array>
+#include <limits>
 
 #include "quantile.hpp"
 #include "histogram.hpp"
+#include "instrument.hpp"
+#include "moments.hpp"
+#include "sums.hpp"
+#include "update.hpp"
 
 
 
@@ -14,6 +20,16 @@ namespace quern
 	namespace detail
 	{
 		template<typename T> using std_vector_of = std::vector<T>;
+
+		/*
+			Walk a tracked quantile record <q> (index_range, samples_lower, sums) to its new position.
+				The quantile is num/den; the caller supplies den and the rank thresholds
+				population*num and population*(den-num).  den may be a std::integral_constant,
+				letting the multiplications in the walk fold into constants.
+		*/
+		template<typename Record, typename Histogram, typename Den, typename Instrument>
+		void adjust_quantile(Record &q, const Histogram &h, size_t population, Den den,
+			size_t lte_ratio, size_t gte_ratio, Instrument &instrument);
 	}
 
 
@@ -24,9 +40,18 @@ namespace quern
 		sample_count_t   -- used to store histogram counts
 		index_t          -- must be able to store twice the number of bins in the histogram
 		quantile_array_t -- type used to store quantile data
+
+		T_Instrument     -- instrumentation policy (see instrument.hpp); none by default
+		T_Moments        -- moment accumulation policy (see moments.hpp); none by default
+		T_Sums           -- per-quantile sum policy (see sums.hpp); none by default
+		T_Update         -- update policy (see update.hpp); eager by default
 	*/
 	template<
-		class    T_HistogramBase>
+		class    T_HistogramBase,
+		class    T_Instrument = tracked_instrument_none,
+		class    T_Moments    = tracked_moments_none,
+		class    T_Sums       = tracked_sums_none,
+		class    T_Update     = tracked_update_eager>
 		//class    T_Quantiles      = std::vector<quantile_fraction<typename T_HistogramBase::index_t>>,
 		//typename T_QuantileValues = std::vector<tracked_quantile<typename T_HistogramBase::count_t, typename T_HistogramBase::index_t>>>
 	class histogram_tracked
@@ -40,6 +65,12 @@ namespace quern
 		using index_t      = typename histogram_t::index_t;
 		using binning_t    = typename histogram_t::binning_t;
 		using params_t     = typename histogram_t::params_t;
+		using instrument_t = T_Instrument;
+		using moments_t    = T_Moments;
+		using sums_t       = T_Sums;
+		using update_t     = T_Update;
+
+		using allocator_type = typename histogram_t::allocator_type;
 
 		/*
 			Data structure representing one tracked quantile.
@@ -58,59 +89,108 @@ namespace quern
 			// This value tracks how many samples are below bin_upper.
 			count_t samples_lower;
 
+			// Sum policy state, updated alongside samples_lower.
+			typename sums_t::quantile_state sums;
+
+			// Rank thresholds population*num and population*(den-num), cached by retarget()
+			//   so that replacements, which leave the population unchanged, skip the multiplies.
+			size_t lte_target = 0, gte_target = 0;
 
-			// DEBUG
-			short last_adjust = 0;
 
+			void retarget(count_t population) noexcept
+			{
+				lte_target = size_t(population) * size_t(quantile.num);
+				gte_target = size_t(population) * size_t(quantile.den - quantile.num);
+			}
 
-			void recalculate(const histogram_t &h, count_t population, bindex_t hint_index = 0);
-			void adjust     (const histogram_t &h, count_t population);
+			// recalculate() retargets; adjust() requires the thresholds to be current.
+			void recalculate(const histogram_t &h, count_t population, instrument_t &instrument, bindex_t hint_index = 0);
+			void adjust     (const histogram_t &h, count_t population, instrument_t &instrument);
 		};
 
-		using quantiles_t = std::vector<quantile>;
+		using quantiles_t = std::vector<quantile,
+			typename std::allocator_traits<allocator_type>::template rebind_alloc<quantile>>;
 
+	private:
+		// Disambiguates quantile lists from allocator arguments (eg, a memory_resource*)
+		template<typename T>
+		using _not_allocator = std::enable_if_t<!std::is_convertible<T, allocator_type>::value>;
 
 	public:
 		/*
 			Default constructor.  This empty histogram will not accept samples.
 		*/
-		explicit histogram_tracked()    : _histogram() {}
+		explicit histogram_tracked()                             : _histogram(), _population(0) {}
+		explicit histogram_tracked(const allocator_type &alloc)    : _histogram(alloc), _population(0), _quantiles(alloc) {}
 
 		/*
 			Set up empty bins based on an array of binning rules.
+				Bins and quantile records are allocated with the given allocator.
 		*/
-		histogram_tracked(const binning_t &binning)    : _histogram(binning), _population(0) {}
-		histogram_tracked(const params_t  &params )    : _histogram(params ), _population(0) {}
+		histogram_tracked(const binning_t &binning, const allocator_type &alloc = allocator_type())    : _histogram(binning, alloc), _population(0), _quantiles(alloc) {}
+		histogram_tracked(const params_t  &params , const allocator_type &alloc = allocator_type())    : _histogram(params , alloc), _population(0), _quantiles(alloc) {}
 
 		/*
 			As above but also specify quantiles to track in the constructor.
 		*/
-		template<typename QuantileList>
-		histogram_tracked(const binning_t &binning, const QuantileList &quantiles)    : _histogram(binning, count_t(0)), _population(0) {_init_quantiles(quantiles);}
-		template<typename QuantileList>
-		histogram_tracked(const params_t  &params , const QuantileList &quantiles)    : _histogram(params , count_t(0)), _population(0) {_init_quantiles(quantiles);}
+		template<typename QuantileList, typename = _not_allocator<QuantileList>>
+		histogram_tracked(const binning_t &binning, const QuantileList &quantiles, const allocator_type &alloc = allocator_type())
+			: _histogram(binning, alloc), _population(0), _quantiles(alloc) {_init_quantiles(quantiles);}
+		template<typename QuantileList, typename = _not_allocator<QuantileList>>
+		histogram_tracked(const params_t  &params , const QuantileList &quantiles, const allocator_type &alloc = allocator_type())
+			: _histogram(params , alloc), _population(0), _quantiles(alloc) {_init_quantiles(quantiles);}
+
+		/*
+			Restore a tracker from saved state (see snapshot.hpp) without rescanning the histogram.
+				The population and quantile states must be consistent with the histogram.
+		*/
+		histogram_tracked(histogram_t &&histogram, count_t population, quantiles_t &&quantiles)
+			: _histogram(std::move(histogram)), _population(population), _quantiles(std::move(quantiles))
+		{
+			for (auto &q : _quantiles) q.retarget(_population);
+		}
 
 
 		template<typename QuantileList>
 		void add_quantiles(const QuantileList &quantiles)
 		{
+			QUERN_TRACE_SCOPE("histogram_tracked::add_quantiles");
 			_quantiles.reserve(_quantiles.size()+std::size(quantiles));
 			for (auto &q : quantiles)
 			{
 				_quantiles.emplace_back(quantile{q});
-				_quantiles.back().recalculate(_histogram, _population);
+				_quantiles.back().recalculate(_histogram, _population, _instrument);
 			}
 		}
 
 		void recalculate()
 		{
+			QUERN_TRACE_SCOPE("histogram_tracked::recalculate");
 			_population = _histogram.calc_population();
 
-			_quantiles.resize(_quantiles.size());
+			for (auto &q : _quantiles)
+			{
+				q.recalculate(_histogram, _population, _instrument);
+			}
+			_stale = false;
+		}
 
+		/*
+			Remove all samples, as at the end of a tumbling window.
+				Costs O(quantiles) plus the histogram's clear (O(1) with generation-tagged storage).
+		*/
+		void clear()
+		{
+			_histogram.clear(count_t(0));
+			_population = 0;
+			_stale      = false;
+			_moments.clear();
 			for (auto &q : _quantiles)
 			{
-				q.recalculate(_histogram, _population);
+				q.index_range   = {0, _histogram.bins()-1};
+				q.samples_lower = 0;
+				q.sums.clear();
+				q.retarget(0);
 			}
 		}
 
@@ -119,55 +199,97 @@ namespace quern
 			Access histogram and quantile readouts.
 		*/
 		const histogram_t &histogram() const noexcept    {return _histogram;}
-		const quantiles_t &quantiles() const noexcept    {return _quantiles;}
+		const quantiles_t &quantiles() const noexcept    {_catch_up(); return _quantiles;}
 
 
 		const count_t     population() const noexcept    {return _population;}
 
+		/*
+			Access the instrumentation policy (eg, to read or reset counters).
+		*/
+		const instrument_t &instrument() const noexcept    {return _instrument;}
+		instrument_t       &instrument()       noexcept    {return _instrument;}
+
+		/*
+			Access the moments policy (eg, mean and variance of the tracked samples).
+		*/
+		const moments_t &moments() const noexcept    {return _moments;}
+
+		/*
+			Mean of the samples between tracked quantiles <lower> and <upper> (indexes into quantiles()),
+				eg the interquartile mean when they track 1/4 and 3/4.  Samples take their bin's
+				midpoint and boundary bins are weighted fractionally, so this costs O(1).
+				Requires a sum policy such as tracked_sums; NaN if the range holds no samples.
+		*/
+		template<typename Sums = sums_t>
+		typename Sums::real_t trimmed_mean(size_t lower, size_t upper) const
+		{
+			using real_t = typename Sums::real_t;
+			_catch_up();
+			const quantile &a = _quantiles[lower], &b = _quantiles[upper];
+			real_t rank_a = _rank<real_t>(a), rank_b = _rank<real_t>(b);
+			if (!(rank_b > rank_a)) return std::numeric_limits<real_t>::quiet_NaN();
+			return (_sum_below<Sums>(b, rank_b) - _sum_below<Sums>(a, rank_a)) / (rank_b - rank_a);
+		}
+
 
 		/*
 			Insert an item.
 		*/
-		void insert(sample_t new_sample)    {insert_at_index(_histogram.index_for(new_sample));}
-		void remove(sample_t old_sample)    {remove_at_index(_histogram.index_for(old_sample));}
+		void insert(sample_t new_sample)    {if (insert_at_index(_histogram.index_for(new_sample))) _moments.insert(new_sample);}
+		void remove(sample_t old_sample)    {if (remove_at_index(_histogram.index_for(old_sample))) _moments.remove(old_sample);}
 
 		/*
 			Replace an item.
 				Essentially "moves" a sample to the insert index from the remove index.
 				This can save work for quantiles that don't need updating.
 		*/
-		void replace(sample_t new_sample, sample_t old_sample)    {replace_at_indexes(_histogram.index_for(new_sample), _histogram.index_for(old_sample));}
+		void replace(sample_t new_sample, sample_t old_sample)
+		{
+			index_t new_index = _histogram.index_for(new_sample), old_index = _histogram.index_for(old_sample);
+			replace_at_indexes(new_index, old_index);
+
+			if      (old_index == BIN_REJECT) {if (new_index != BIN_REJECT) _moments.insert(new_sample);}
+			else if (new_index == BIN_REJECT) _moments.remove(old_sample);
+			else                              _moments.replace(new_sample, old_sample);
+		}
 
-		void insert_at_index(index_t new_index)
+		/*
+			Insert or remove by bin index, bypassing the moments policy.
+				Returns whether the index was within the histogram.
+		*/
+		bool insert_at_index(index_t new_index)
 		{
-			count_t miss = 0;
-			_histogram.at_index(new_index, miss) += 1;
-			if (!miss)
+			bool hit = _histogram.add_at(new_index);
+			if (hit)
 			{
 				++_population;
 				for (auto &q : _quantiles)
 				{
-					if (new_index < q.index_range.upper) ++q.samples_lower;
-					q.adjust(_histogram, _population);
+					if (new_index < q.index_range.upper) {++q.samples_lower; q.sums.add(_histogram, new_index, 1);}
+					if constexpr (!update_t::lazy) {q.retarget(_population); q.adjust(_histogram, _population, _instrument);}
 				}
+				if constexpr (update_t::lazy) _stale = true;
 			}
-			else {for (auto &q : _quantiles) q.last_adjust = -2;}
+			else _instrument.reject();
+			return hit;
 		}
 
-		void remove_at_index(index_t old_index)
+		bool remove_at_index(index_t old_index)
 		{
-			count_t hit = 1;
-			_histogram.at_index(old_index, hit) -= 1;
+			bool hit = _histogram.sub_at(old_index);
 			if (hit)
 			{
 				--_population;
 				for (auto &q : _quantiles)
 				{
-					if (old_index < q.index_range.upper) --q.samples_lower;
-					q.adjust(_histogram, _population);
+					if (old_index < q.index_range.upper) {--q.samples_lower; q.sums.sub(_histogram, old_index, 1);}
+					if constexpr (!update_t::lazy) {q.retarget(_population); q.adjust(_histogram, _population, _instrument);}
 				}
+				if constexpr (update_t::lazy) _stale = true;
 			}
-			else {for (auto &q : _quantiles) q.last_adjust = -3;}
+			else _instrument.reject();
+			return hit;
 		}
 
 		void replace_at_indexes(index_t new_index, index_t old_index)
@@ -185,27 +307,61 @@ namespace quern
 
 			if (new_index != old_index)
 			{
-				count_t dummy;
-				_histogram.at_index(new_index, dummy) += 1;
-				_histogram.at_index(old_index, dummy) -= 1;
+				_histogram.add_at(new_index);
+				_histogram.sub_at(old_index);
 
+				// The population is unchanged, so each quantile's cached thresholds still hold.
 				for (auto &q : _quantiles)
 				{
-					q.last_adjust = 9;
-
 					// No need to adjust if samples are both outside the quantile in the same direction
 					if (new_index > q.index_range.upper && old_index > q.index_range.upper) continue;
-					if (new_index < q.index_range.lower && old_index < q.index_range.lower) continue;
+					if (new_index < q.index_range.lower && old_index < q.index_range.lower)
+					{
+						// The count below is unchanged, but the sum below is not.
+						q.sums.add(_histogram, new_index, 1);
+						q.sums.sub(_histogram, old_index, 1);
+						continue;
+					}
 
 					// Adjust the quantile.
-					q.samples_lower += (new_index < q.index_range.upper) - (old_index < q.index_range.upper);
-					q.adjust(_histogram, _population);
+					if (new_index < q.index_range.upper) {++q.samples_lower; q.sums.add(_histogram, new_index, 1);}
+					if (old_index < q.index_range.upper) {--q.samples_lower; q.sums.sub(_histogram, old_index, 1);}
+					if constexpr (!update_t::lazy) q.adjust(_histogram, _population, _instrument);
 				}
+				if constexpr (update_t::lazy) _stale = true;
 			}
 		}
 
 
 	private:
+		// Under lazy updates, walk each quantile to its current position after any writes.
+		void _catch_up() const noexcept
+		{
+			if constexpr (update_t::lazy)
+			{
+				if (!_stale) return;
+				QUERN_TRACE_SCOPE("histogram_tracked::catch_up");
+				for (auto &q : _quantiles)
+				{
+					q.retarget(_population);
+					q.adjust(_histogram, _population, _instrument);
+				}
+				_stale = false;
+			}
+		}
+
+		// Fractional rank of a quantile:  population * num / den.
+		template<typename Real>
+		Real _rank(const quantile &q) const noexcept    {return Real(_population) * Real(q.quantile.num) / Real(q.quantile.den);}
+
+		// Sum of the <rank> lowest samples.  The quantile's upper bin holds the samples from samples_lower up.
+		template<typename Sums, typename Real>
+		Real _sum_below(const quantile &q, Real rank) const noexcept
+		{
+			Real extra = std::min(std::max(rank - Real(q.samples_lower), Real(0)), Real(_histogram.count_at(q.index_range.upper)));
+			return q.sums.sum_lower + extra * Sums::value(_histogram, q.index_range.upper);
+		}
+
 		template<typename QuantileList>
 		void _init_quantiles(const QuantileList &quantiles)
 		{
@@ -213,17 +369,21 @@ namespace quern
 			for (auto &q : quantiles) _quantiles.emplace_back(quantile{q, {0,_histogram.bins()-1}});
 		}
 
-		histogram_t    _histogram;
-		count_t        _population;
-		quantiles_t    _quantiles;
+		// Quantiles and instrument are mutable so that lazy reads can catch up.
+		histogram_t          _histogram;
+		count_t              _population;
+		mutable quantiles_t  _quantiles;
+		mutable instrument_t _instrument;
+		moments_t            _moments;
+		mutable bool         _stale = false;
 	};
 }
 
 
 
-template<typename Histogram>
-void quern::histogram_tracked<Histogram>::quantile::recalculate
-	(const Histogram &h, count_t population, bindex_t hint_index)
+template<typename Histogram, typename Instrument, typename Moments, typename Sums, typename Update>
+void quern::histogram_tracked<Histogram, Instrument, Moments, Sums, Update>::quantile::recalculate
+	(const Histogram &h, count_t population, instrument_t &instrument, bindex_t hint_index)
 {
 	if (quantile.den <= 0)            throw std::logic_error("Invalid quantile: denominator <= 0");
 	if (quantile.num <= 0)            throw std::logic_error("Invalid quantile: ratio <= 0");
@@ -231,79 +391,98 @@ void quern::histogram_tracked<Histogram>::quantile::recalculate
 
 	auto size = h.bins();
 
+	retarget(population);
 	if (hint_index >= size) hint_index = size - (size > 0);
 
 	index_range.lower = index_range.upper = hint_index;
 	samples_lower = 0;
-	for (index_t i = 0; i < hint_index; ++i) samples_lower += h.count_at(i);
-	adjust(h, population);
+	sums.clear();
+	for (index_t i = 0; i < hint_index; ++i)
+	{
+		count_t c = h.count_at(i);
+		samples_lower += c;
+		sums.add(h, i, c);
+	}
+	adjust(h, population, instrument);
 }
 
-template<typename Histogram>
-void quern::histogram_tracked<Histogram>::quantile::adjust
-	(const histogram_t &h, count_t population)
+template<typename Histogram, typename Instrument, typename Moments, typename Sums, typename Update>
+void quern::histogram_tracked<Histogram, Instrument, Moments, Sums, Update>::quantile::adjust
+	(const histogram_t &h, count_t population, instrument_t &instrument)
 {
-	auto size = h.bins();
+	detail::adjust_quantile(*this, h, population, size_t(quantile.den), lte_target, gte_target, instrument);
+}
+
+template<typename Record, typename Histogram, typename Den, typename Instrument>
+void quern::detail::adjust_quantile(Record &q, const Histogram &h, size_t population, Den den,
+	size_t lte_ratio, size_t gte_ratio, Instrument &instrument)
+{
+	QUERN_TRACE_SCOPE("quantile::adjust");
+
+	auto  size          = h.bins();
+	auto &index_range   = q.index_range;
+	auto &samples_lower = q.samples_lower;
+	auto &sums          = q.sums;
 
 	// "smash" any range to its upper bound
-	bindex_t bin = index_range.upper;
-	count_t
+	bindex_t bin = index_range.upper, start = bin;
+	auto
 		here  = h.count_at(bin);
 	size_t
 		gte   = population - samples_lower,
 		lte   = here + samples_lower;
-	size_t
-		lte_ratio = population*quantile.num,
-		gte_ratio = population*(quantile.den-quantile.num);
 
-	if (lte*quantile.den < lte_ratio)
+	if (lte*den < lte_ratio)
 	{
-		last_adjust = 1;
+		instrument.adjust(1);
 
 		// Slide the quantile higher
-		while (bin+1 < size && lte*quantile.den < lte_ratio)
+		while (bin+1 < size && lte*den < lte_ratio)
 		{
 			samples_lower += here;
+			sums.add(h, bin, here);
 			here = h.count_at(++bin);
 			//q.samples_higher -= here;
 			lte += here;
-			if (lte*quantile.den >= lte_ratio) break;
+			if (lte*den >= lte_ratio) break;
 		}
 
 		// Determine the median bin, or bin range in case of a split
 		index_range.lower = bin;
-		if (lte*quantile.den == lte_ratio)
+		if (lte*den == lte_ratio)
 		{
 			samples_lower += here;
-			while (bin+1 < size && h.count_at(++bin) == 0) {}
+			sums.add(h, bin, here);
+			while (bin+1 < size && h.count_at(++bin) == 0) {instrument.skip_empty();}
 		}
 		index_range.upper = bin;
 	}
-	else if (gte*quantile.den < gte_ratio)
+	else if (gte*den < gte_ratio)
 	{
-		last_adjust = -1;
+		instrument.adjust(-1);
 
 		// Slide the quantile lower
-		while (bin > 0 && gte*quantile.den < gte_ratio)
+		while (bin > 0 && gte*den < gte_ratio)
 		{
 			//q.samples_higher += here;
 			here = h.count_at(--bin);
 			samples_lower -= here;
+			sums.sub(h, bin, here);
 			gte += here;
-			if (gte*quantile.den >= gte_ratio) break;
+			if (gte*den >= gte_ratio) break;
 		}
 
 		// Determine the median bin, or bin range in case of a split
 		index_range.upper = bin;
-		if (gte*quantile.den == gte_ratio)
+		if (gte*den == gte_ratio)
 		{
-			while (bin > 0 && h.count_at(--bin) == 0) {}
+			while (bin > 0 && h.count_at(--bin) == 0) {instrument.skip_empty();}
 		}
 		index_range.lower = bin;
 	}
 	else
 	{
-		last_adjust = 0;
+		instrument.adjust(0);
 
 		// Elements <= bin and >= bin are partitioned...
 		index_range.lower = index_range.upper = bin;
@@ -311,15 +490,20 @@ void quern::histogram_tracked<Histogram>::quantile::adjust
 		while (index_range.lower > 0) // expand range downward
 		{
 			lte -= h.count_at(index_range.lower);
-			if (lte*quantile.den < lte_ratio) break;
+			if (lte*den < lte_ratio) break;
 			--index_range.lower;
 		}
 		while (index_range.upper+1 < size) // expand range upward
 		{
-			gte -= h.count_at(index_range.upper);
-			if (gte*quantile.den < gte_ratio) break;
-			samples_lower += h.count_at(index_range.upper);
+			auto upper = h.count_at(index_range.upper);
+			gte -= upper;
+			if (gte*den < gte_ratio) break;
+			samples_lower += upper;
+			sums.add(h, index_range.upper, upper);
 			++index_range.upper;
 		}
 	}
-}
\ No newline at end of file
+
+	instrument.walk(size_t(std::max<bindex_t>(index_range.upper, start) - std::min<bindex_t>(index_range.lower, start)));
+	if (index_range.is_range()) instrument.split();
+}
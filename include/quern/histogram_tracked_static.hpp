@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <ratio>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "histogram_tracked.hpp"
+
+
+namespace quern
+{
+	/*
+		A histogram_tracked whose quantiles are fixed at compile time, as std::ratio types.
+
+			histogram_tracked_static<histogram<float>, std::ratio<1,2>, std::ratio<9,10>, std::ratio<99,100>>
+
+		Quantile records live in a std::array and each update visits them in an unrolled
+			sequence.  Each quantile's denominator is a constant in its walk, so the
+			comparisons multiply by constants (shifts, for powers of two) and the rank
+			thresholds cost one constant multiply per update.  Readouts match
+			histogram_tracked:  quantiles() holds the same quantile records, in order.
+
+		There are no instrument, moment or sum policies; use histogram_tracked for those.
+	*/
+	template<class T_HistogramBase, class... Fractions>
+	class histogram_tracked_static
+	{
+	public:
+		static_assert(T_HistogramBase::dimensionality == 1, "histogram_tracked_static must be 1-dimensional");
+		static_assert(sizeof...(Fractions) > 0, "histogram_tracked_static needs at least one quantile");
+		static_assert(((Fractions::num > 0 && Fractions::num < Fractions::den) && ...),
+			"histogram_tracked_static quantiles must lie strictly between 0 and 1");
+
+		using histogram_t = T_HistogramBase;
+		using sample_t    = typename histogram_t::sample_t;
+		using count_t     = typename histogram_t::count_t;
+		using index_t     = typename histogram_t::index_t;
+		using binning_t   = typename histogram_t::binning_t;
+		using params_t    = typename histogram_t::params_t;
+		using quantile    = typename histogram_tracked<histogram_t>::quantile;
+		using quantiles_t = std::array<quantile, sizeof...(Fractions)>;
+
+		using allocator_type = typename histogram_t::allocator_type;
+
+	public:
+		/*
+			Set up empty bins based on an array of binning rules.
+		*/
+		histogram_tracked_static(const binning_t &binning, const allocator_type &alloc = allocator_type())    : _histogram(binning, alloc), _quantiles(_initial()) {}
+		histogram_tracked_static(const params_t  &params , const allocator_type &alloc = allocator_type())    : _histogram(params , alloc), _quantiles(_initial()) {}
+
+
+		void recalculate()
+		{
+			QUERN_TRACE_SCOPE("histogram_tracked_static::recalculate");
+			_population = _histogram.calc_population();
+			_each([this](quantile &q, auto fraction)
+			{
+				q.index_range   = {0, 0};
+				q.samples_lower = 0;
+				_adjust(q, fraction);
+			});
+		}
+
+		void clear()
+		{
+			_histogram.clear(count_t(0));
+			_population = 0;
+			for (auto &q : _quantiles)
+			{
+				q.index_range   = {0, _histogram.bins()-1};
+				q.samples_lower = 0;
+			}
+		}
+
+
+		/*
+			Access histogram and quantile readouts.
+		*/
+		const histogram_t &histogram()  const noexcept    {return _histogram;}
+		const quantiles_t &quantiles()  const noexcept    {return _quantiles;}
+		const count_t      population() const noexcept    {return _population;}
+
+
+		/*
+			Insert, remove or replace an item.
+		*/
+		void insert (sample_t new_sample)                       {insert_at_index(_histogram.index_for(new_sample));}
+		void remove (sample_t old_sample)                       {remove_at_index(_histogram.index_for(old_sample));}
+		void replace(sample_t new_sample, sample_t old_sample)    {replace_at_indexes(_histogram.index_for(new_sample), _histogram.index_for(old_sample));}
+
+		bool insert_at_index(index_t new_index)
+		{
+			if (!_histogram.add_at(new_index)) return false;
+			++_population;
+			_each([this, new_index](quantile &q, auto fraction)
+			{
+				if (new_index < q.index_range.upper) ++q.samples_lower;
+				_adjust(q, fraction);
+			});
+			return true;
+		}
+
+		bool remove_at_index(index_t old_index)
+		{
+			if (!_histogram.sub_at(old_index)) return false;
+			--_population;
+			_each([this, old_index](quantile &q, auto fraction)
+			{
+				if (old_index < q.index_range.upper) --q.samples_lower;
+				_adjust(q, fraction);
+			});
+			return true;
+		}
+
+		void replace_at_indexes(index_t new_index, index_t old_index)
+		{
+			if (new_index == BIN_REJECT) {remove_at_index(old_index); return;}
+			if (old_index == BIN_REJECT) {insert_at_index(new_index); return;}
+			if (new_index == old_index) return;
+
+			_histogram.add_at(new_index);
+			_histogram.sub_at(old_index);
+			_each([this, new_index, old_index](quantile &q, auto fraction)
+			{
+				if (new_index > q.index_range.upper && old_index > q.index_range.upper) return;
+				if (new_index < q.index_range.lower && old_index < q.index_range.lower) return;
+				q.samples_lower += (new_index < q.index_range.upper);
+				q.samples_lower -= (old_index < q.index_range.upper);
+				_adjust(q, fraction);
+			});
+		}
+
+
+	private:
+		// Visit each quantile record with its ratio type, unrolled.
+		template<typename Func>
+		void _each(Func &&func)    {_each(func, std::index_sequence_for<Fractions...>());}
+		template<typename Func, size_t... I>
+		void _each(Func &func, std::index_sequence<I...>)    {(func(std::get<I>(_quantiles), Fractions()), ...);}
+
+		template<typename Ratio>
+		void _adjust(quantile &q, Ratio)
+		{
+			tracked_instrument_none none;
+			detail::adjust_quantile(q, _histogram, _population, std::integral_constant<size_t, size_t(Ratio::den)>(),
+				size_t(_population) * size_t(Ratio::num), size_t(_population) * size_t(Ratio::den - Ratio::num), none);
+		}
+
+		quantiles_t _initial() const
+		{
+			return {quantile{quantile_fraction<index_t>(index_t(Fractions::num), index_t(Fractions::den)), {0, _histogram.bins()-1}, 0, {}}...};
+		}
+
+		histogram_t _histogram;
+		count_t     _population = 0;
+		quantiles_t _quantiles;
+	};
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace quern
+{
+	/*
+		Instrumentation policies for histogram_tracked.
+			The tracker calls these hooks from its hot paths.  The default policy's
+			hooks are empty, so instrumentation costs nothing unless enabled.
+
+			adjust(direction) -- a quantile was adjusted:  +1 upward, -1 downward, 0 in place
+			walk(bins)        -- number of bins spanned by one adjust
+			skip_empty()      -- an empty bin was skipped while resolving a split quantile
+			reject()          -- an inserted or removed sample fell outside the binning
+			split()           -- an adjust left a quantile split between two bins
+	*/
+	struct tracked_instrument_none
+	{
+		void adjust(int)         noexcept {}
+		void walk(size_t)        noexcept {}
+		void skip_empty()        noexcept {}
+		void reject()            noexcept {}
+		void split()             noexcept {}
+	};
+
+
+	/*
+		Counts every hook call, for profiling production streams.
+			Bins walked per adjust are also kept as a log2 histogram:
+			bucket 0 counts walks of 0 bins, bucket k counts walks of [2^(k-1), 2^k) bins.
+	*/
+	struct tracked_instrument_counters
+	{
+		static constexpr size_t walk_buckets = 24;
+
+		uint64_t adjusts_up      = 0,
+		         adjusts_down    = 0,
+		         adjusts_inplace = 0,
+		         bins_walked     = 0,
+		         empty_skips     = 0,
+		         rejects         = 0,
+		         splits          = 0;
+		uint64_t walk_histogram[walk_buckets] = {};
+
+		void adjust(int direction) noexcept
+		{
+			if      (direction > 0) ++adjusts_up;
+			else if (direction < 0) ++adjusts_down;
+			else                    ++adjusts_inplace;
+		}
+		void walk(size_t bins) noexcept
+		{
+			bins_walked += bins;
+			++walk_histogram[walk_bucket(bins)];
+		}
+		void skip_empty() noexcept    {++empty_skips;}
+		void reject()     noexcept    {++rejects;}
+		void split()      noexcept    {++splits;}
+
+		uint64_t adjusts() const noexcept    {return adjusts_up + adjusts_down + adjusts_inplace;}
+
+		void reset() noexcept    {*this = tracked_instrument_counters();}
+
+		static size_t walk_bucket(size_t bins) noexcept
+		{
+			size_t bucket = 0;
+			while (bins && bucket+1 < walk_buckets) {bins >>= 1; ++bucket;}
+			return bucket;
+		}
+	};
+}
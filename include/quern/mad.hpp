@@ -0,0 +1,199 @@
+#pragma once
+
+#include <utility>
+#include <algorithm>
+
+#include "histogram_tracked.hpp"
+
+
+namespace quern
+{
+	/*
+		A histogram_tracked which also tracks the median absolute deviation (MAD),
+			the median of |x - median|, from the same count grid.
+
+		The median is tracked as an extra quantile, appended after any others.  Around
+			it the tracker keeps a symmetric window of bins and the count of samples in
+			that window.  The window's radius is the MAD:  the smallest radius holding
+			at least half the population.  When samples change or the median moves,
+			the window's edges and radius walk incrementally, as quantile::adjust does,
+			so each update costs O(1) plus the distance moved.
+
+		Distances are measured between bin midpoints, from the center of the median's
+			bin range, so the radius is kept in half-bins.
+
+		T_Tracked  -- a histogram_tracked
+	*/
+	template<class T_Tracked>
+	class histogram_tracked_mad
+	{
+	public:
+		using tracked_t   = T_Tracked;
+		using histogram_t = typename tracked_t::histogram_t;
+		using sample_t    = typename tracked_t::sample_t;
+		using count_t     = typename tracked_t::count_t;
+		using index_t     = typename tracked_t::index_t;
+		using binning_t   = typename tracked_t::binning_t;
+		using params_t    = typename tracked_t::params_t;
+		using quantile_t  = typename tracked_t::quantile;
+		using quantiles_t = typename tracked_t::quantiles_t;
+
+	public:
+		/*
+			Construct the underlying tracker from binning rules or parameters and any further
+				arguments (quantiles, allocator), then add the median.
+		*/
+		template<typename... Args>
+		explicit histogram_tracked_mad(const binning_t &binning, Args&&... more)
+			: _tracked(binning, std::forward<Args>(more)...) {_init();}
+		template<typename... Args>
+		explicit histogram_tracked_mad(const params_t  &params , Args&&... more)
+			: _tracked(params , std::forward<Args>(more)...) {_init();}
+
+
+		void recalculate()
+		{
+			_tracked.recalculate();
+			_reset();
+			_update();
+		}
+
+		void clear()
+		{
+			_tracked.clear();
+			_reset();
+		}
+
+
+		/*
+			Access the tracker and its readouts.  quantiles() includes the median, last.
+		*/
+		const tracked_t   &tracked()    const noexcept    {return _tracked;}
+		const histogram_t &histogram()  const noexcept    {return _tracked.histogram();}
+		const quantiles_t &quantiles()  const noexcept    {return _tracked.quantiles();}
+		const count_t      population() const noexcept    {return _tracked.population();}
+
+		const quantile_t  &median()     const noexcept    {return _tracked.quantiles()[_median];}
+
+		/*
+			The MAD as a radius in half-bins around the median.
+		*/
+		index_t radius() const noexcept    {return _radius;}
+
+		/*
+			The MAD in sample units, assuming bins of equal width.
+		*/
+		template<typename Real = double>
+		Real mad() const
+		{
+			auto &rule = _tracked.histogram().binning();
+			if (rule.bins() < 2) return Real(0);
+			return Real(_radius) * (Real(rule.mid({1})) - Real(rule.mid({0}))) / Real(2);
+		}
+
+
+		/*
+			Insert, remove or replace a sample.
+		*/
+		void insert(const sample_t &new_sample)
+		{
+			_tracked.insert(new_sample);
+			_note(_tracked.histogram().index_for(new_sample), 1);
+			_update();
+		}
+
+		void remove(const sample_t &old_sample)
+		{
+			_tracked.remove(old_sample);
+			_note(_tracked.histogram().index_for(old_sample), -1);
+			_update();
+		}
+
+		void replace(const sample_t &new_sample, const sample_t &old_sample)
+		{
+			_tracked.replace(new_sample, old_sample);
+			_note(_tracked.histogram().index_for(new_sample),  1);
+			_note(_tracked.histogram().index_for(old_sample), -1);
+			_update();
+		}
+
+
+	private:
+		void _init()
+		{
+			_median = _tracked.quantiles().size();
+			const quantile_fraction<index_t> half[] = {{1, 2}};
+			_tracked.add_quantiles(half);
+			_reset();
+			_update();
+		}
+
+		void _reset()    {_lo = 0; _hi = -1; _inside = 0; _radius = 0;}
+
+		// A sample entered or left bin <index>; count it if it lies in the window.
+		void _note(index_t index, int delta)
+		{
+			if (index != BIN_REJECT && index >= _lo && index <= _hi) _inside += delta;
+		}
+
+		// The window of bins within <radius> half-bins of center2 / 2, clamped to the histogram.
+		static index_t _floor_half(index_t x) noexcept    {return (x >= 0) ? x / 2 : -((1 - x) / 2);}
+
+		void _bounds(index_t center2, index_t radius, index_t &lo, index_t &hi) const
+		{
+			lo = std::max(index_t(0), -_floor_half(radius - center2));
+			hi = std::min(index_t(_tracked.histogram().bins() - 1), _floor_half(center2 + radius));
+		}
+
+		// Walk the window's edges to [lo, hi], growing before shrinking so the count stays exact.
+		void _move(index_t lo, index_t hi)
+		{
+			auto &h = _tracked.histogram();
+			while (_lo > lo) _inside += h.count_at(--_lo);
+			while (_hi < hi) _inside += h.count_at(++_hi);
+			while (_lo < lo) _inside -= h.count_at(_lo++);
+			while (_hi > hi) _inside -= h.count_at(_hi--);
+		}
+
+		// Re-center the window on the median, then grow or shrink its radius.
+		void _update()
+		{
+			if (_tracked.histogram().bins() <= 0) return;
+
+			auto   &h          = _tracked.histogram();
+			auto   &m          = median();
+			index_t center2    = m.index_range.lower + m.index_range.upper, lo, hi;
+			size_t  population = _tracked.population();
+
+			_bounds(center2, _radius, lo, hi);
+			_move(lo, hi);
+
+			// Grow until the window holds half the population.
+			while (2*size_t(_inside) < population && (_lo > 0 || _hi < h.bins() - 1))
+			{
+				_bounds(center2, ++_radius, lo, hi);
+				_move(lo, hi);
+			}
+
+			// Shrink while it still would.
+			while (_radius > 0)
+			{
+				_bounds(center2, _radius - 1, lo, hi);
+				size_t dropped = 0;
+				if (lo > _lo)                             dropped += h.count_at(_lo);
+				if (hi < _hi && !(lo > _lo && _hi == _lo)) dropped += h.count_at(_hi);
+				if (2*(size_t(_inside) - dropped) < population) break;
+				--_radius;
+				_move(lo, hi);
+			}
+		}
+
+		tracked_t _tracked;
+		size_t    _median = 0;
+
+		// Window of bins [_lo, _hi] holding _inside samples, of radius _radius half-bins.
+		index_t   _lo = 0, _hi = -1;
+		count_t   _inside = 0;
+		index_t   _radius = 0;
+	};
+}
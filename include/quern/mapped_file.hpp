@@ -0,0 +1,137 @@
+#pragma once
+
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+
+namespace quern
+{
+	/*
+		A whole file mapped into memory.
+			READ_ONLY maps the file for reading.
+			COPY_ON_WRITE also allows writes, which are private to this process
+			and never reach the file.
+
+		Throws std::system_error if the file cannot be opened or mapped.
+	*/
+	class mapped_file
+	{
+	public:
+		enum MAP_MODE
+		{
+			READ_ONLY     = 0,
+			COPY_ON_WRITE = 1,
+		};
+
+	public:
+		mapped_file() noexcept    : _data(nullptr), _size(0) {}
+
+		explicit mapped_file(const std::string &path, MAP_MODE mode = READ_ONLY)
+			: _data(nullptr), _size(0) {_map(path, mode);}
+
+		~mapped_file()    {_unmap();}
+
+		mapped_file(mapped_file &&o) noexcept
+			: _data(o._data), _size(o._size) {o._data = nullptr; o._size = 0;}
+		mapped_file &operator=(mapped_file &&o) noexcept
+		{
+			if (this != &o)
+			{
+				_unmap();
+				_data = o._data; o._data = nullptr;
+				_size = o._size; o._size = 0;
+			}
+			return *this;
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file &operator=(const mapped_file&) = delete;
+
+		/*
+			Access the mapped bytes.  Empty files map to a null pointer.
+		*/
+		const void *data () const noexcept    {return _data;}
+		void       *data ()       noexcept    {return _data;}
+		size_t      size () const noexcept    {return _size;}
+		bool        empty() const noexcept    {return _size == 0;}
+
+
+	private:
+		void   *_data;
+		size_t  _size;
+
+#ifdef _WIN32
+		void _map(const std::string &path, MAP_MODE mode)
+		{
+			HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) _fail(path);
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file, &size)) {CloseHandle(file); _fail(path);}
+			_size = size_t(size.QuadPart);
+
+			if (_size)
+			{
+				HANDLE mapping = CreateFileMappingA(file, nullptr,
+					(mode == COPY_ON_WRITE) ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+				if (mapping) _data = MapViewOfFile(mapping,
+					(mode == COPY_ON_WRITE) ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+				if (mapping) CloseHandle(mapping);
+				if (!_data) {CloseHandle(file); _size = 0; _fail(path);}
+			}
+			CloseHandle(file);
+		}
+		void _unmap() noexcept
+		{
+			if (_data) UnmapViewOfFile(_data);
+			_data = nullptr; _size = 0;
+		}
+		[[noreturn]] static void _fail(const std::string &path)
+		{
+			throw std::system_error(int(GetLastError()), std::system_category(), "mapping " + path);
+		}
+#else
+		void _map(const std::string &path, MAP_MODE mode)
+		{
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) _fail(path);
+
+			struct stat info;
+			if (::fstat(fd, &info) != 0) {int e = errno; ::close(fd); _fail(path, e);}
+			_size = size_t(info.st_size);
+
+			if (_size)
+			{
+				int prot = PROT_READ | ((mode == COPY_ON_WRITE) ? PROT_WRITE : 0);
+				void *data = ::mmap(nullptr, _size, prot, MAP_PRIVATE, fd, 0);
+				if (data == MAP_FAILED) {int e = errno; ::close(fd); _size = 0; _fail(path, e);}
+				_data = data;
+			}
+			::close(fd);
+		}
+		void _unmap() noexcept
+		{
+			if (_data) ::munmap(_data, _size);
+			_data = nullptr; _size = 0;
+		}
+		[[noreturn]] static void _fail(const std::string &path, int error = errno)
+		{
+			throw std::system_error(error, std::generic_category(), "mapping " + path);
+		}
+#endif
+	};
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+#include "histogram.hpp"
+
+
+namespace quern
+{
+	/*
+		A tournament tree over bin counts, tracking the fullest bin.
+			Each node holds the count and index of the winner among the bins below it;
+			ties go to the lower index.  Leaves are padded to a power of two with empty
+			entries.  Updating one bin replays its matches to the root in O(log bins),
+			reading only the tree, and the winner is read from the root in O(1).
+	*/
+	template<typename Count, typename Index = bindex_t, typename Allocator = std::allocator<Count>>
+	class mode_tree
+	{
+	public:
+		using count_t = Count;
+		using index_t = Index;
+
+		struct node
+		{
+			count_t count;
+			index_t index; // -1 for padding
+		};
+
+		using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+
+	public:
+		explicit mode_tree(const allocator_type &alloc = allocator_type())    : _nodes(alloc), _leaves(0) {}
+
+		/*
+			Rebuild over <bins> bins, where count(i) gives the count of bin i.  O(bins).
+		*/
+		template<typename CountFunc>
+		void reset(index_t bins, CountFunc &&count)
+		{
+			_leaves = 1;
+			while (_leaves < size_t(bins)) _leaves <<= 1;
+			_nodes.assign(2 * _leaves, node{count_t(0), index_t(-1)});
+			for (index_t i = 0; i < bins; ++i) _nodes[_leaves + i] = node{count(i), i};
+			for (size_t n = _leaves - 1; n > 0; --n) _nodes[n] = _match(_nodes[2*n], _nodes[2*n+1]);
+		}
+
+		/*
+			Bin <index> now holds <count>.  O(log bins).
+		*/
+		void update(index_t index, count_t count) noexcept
+		{
+			size_t n = _leaves + size_t(index);
+			_nodes[n].count = count;
+			for (n >>= 1; n > 0; n >>= 1) _nodes[n] = _match(_nodes[2*n], _nodes[2*n+1]);
+		}
+
+		/*
+			The fullest bin and its count.  The index is -1 if there are no bins.
+		*/
+		index_t winner()       const noexcept    {return _nodes.empty() ? index_t(-1) : _nodes[1].index;}
+		count_t winner_count() const noexcept    {return _nodes.empty() ? count_t(0) : _nodes[1].count;}
+
+	private:
+		static node _match(const node &a, const node &b) noexcept
+		{
+			if (b.index < 0) return a;
+			if (a.index < 0) return b;
+			return (b.count > a.count) ? b : a;
+		}
+
+		std::vector<node, allocator_type> _nodes;
+		size_t                            _leaves;
+	};
+
+
+	/*
+		A histogram which tracks its mode (the fullest bin) under add_at and sub_at.
+			Each update costs O(log bins) on top of the count itself; mode reads are O(1).
+			Works with any binning, including discrete and enumerated values, and may be
+			used as the base histogram of a histogram_tracked.
+
+			clear() and reformat() rebuild the tree in O(bins).  Writes through at_index()
+			bypass the tree; call recount() afterward.
+	*/
+	template<class T_Histogram>
+	class histogram_mode : public T_Histogram
+	{
+	public:
+		using histogram_t    = T_Histogram;
+		using sample_t       = typename histogram_t::sample_t;
+		using count_t        = typename histogram_t::count_t;
+		using index_t        = typename histogram_t::index_t;
+		using coord_t        = typename histogram_t::coord_t;
+		using binning_t      = typename histogram_t::binning_t;
+		using params_t       = typename histogram_t::params_t;
+		using storage_t      = typename histogram_t::storage_t;
+		using allocator_type = typename histogram_t::allocator_type;
+		using tree_t         = mode_tree<count_t, index_t, allocator_type>;
+
+	public:
+		explicit histogram_mode()                             : histogram_t()     , _tree()      {recount();}
+		explicit histogram_mode(const allocator_type &alloc)    : histogram_t(alloc), _tree(alloc) {recount();}
+
+		histogram_mode(const binning_t &binning, const allocator_type &alloc = allocator_type())
+			: histogram_t(binning, alloc), _tree(alloc) {recount();}
+		histogram_mode(const params_t  &params , const allocator_type &alloc = allocator_type())
+			: histogram_t(params , alloc), _tree(alloc) {recount();}
+		histogram_mode(const binning_t &binning, storage_t &&store)
+			: histogram_t(binning, std::move(store)), _tree(this->get_allocator()) {recount();}
+
+
+		/*
+			Add or subtract samples, updating the mode.
+				Returns whether the sample was in binning range.
+		*/
+		bool add_at(const index_t   index,  const count_t n = 1) noexcept    {return histogram_t::add_at(index, n) && _touch(index);}
+		bool sub_at(const index_t   index,  const count_t n = 1) noexcept    {return histogram_t::sub_at(index, n) && _touch(index);}
+		bool add_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return add_at(this->coord_to_index(coord), n);}
+		bool sub_at(const coord_t  &coord,  const count_t n = 1) noexcept    {return sub_at(this->coord_to_index(coord), n);}
+		bool add   (const sample_t &sample, const count_t n = 1) noexcept    {return add_at(this->index_for(sample), n);}
+		bool sub   (const sample_t &sample, const count_t n = 1) noexcept    {return sub_at(this->index_for(sample), n);}
+
+		size_t add_indexes(const index_t *indexes, size_t count, const count_t n = 1) noexcept
+			{size_t hits = 0; for (size_t i = 0; i < count; ++i) hits += add_at(indexes[i], n); return hits;}
+		size_t sub_indexes(const index_t *indexes, size_t count, const count_t n = 1) noexcept
+			{size_t hits = 0; for (size_t i = 0; i < count; ++i) hits += sub_at(indexes[i], n); return hits;}
+
+		template<typename... Columns>
+		size_t add_columns(size_t count, const Columns*... columns)
+			{return this->_column_batches(count, [this](const index_t *i, size_t n) {return add_indexes(i, n);}, columns...);}
+		template<typename... Columns>
+		size_t sub_columns(size_t count, const Columns*... columns)
+			{return this->_column_batches(count, [this](const index_t *i, size_t n) {return sub_indexes(i, n);}, columns...);}
+
+		/*
+			Bulk fills recount the tree once afterward, unless the batch is smaller than the grid.
+		*/
+		size_t fill_indexes(const index_t *indexes, size_t count, const count_t n = 1, fill_strategy strategy = FILL_AUTO)
+		{
+			if (count < size_t(this->bins())) return add_indexes(indexes, count, n);
+			size_t hits = histogram_t::fill_indexes(indexes, count, n, strategy);
+			recount();
+			return hits;
+		}
+		template<typename... Columns>
+		size_t fill_columns(size_t count, const Columns*... columns)
+		{
+			typename histogram_t::_index_vector indexes(count, index_t(0), this->get_allocator());
+			this->index_for_columns(indexes.data(), count, columns...);
+			return fill_indexes(indexes.data(), count);
+		}
+
+		void clear   (const count_t fill = count_t(0))                          {histogram_t::clear(fill);             recount();}
+		void reformat(const binning_t &binning, const count_t fill = count_t(0))    {histogram_t::reformat(binning, fill); recount();}
+
+		/*
+			Rebuild the tree from the counts.  O(bins).
+		*/
+		void recount()    {_tree.reset(this->bins(), [this](index_t i) {return this->count_at(i);});}
+
+
+		/*
+			The fullest bin (lowest index on ties), its count, and its central value.
+				mode_index() is -1 if the histogram has no bins, and mode() then throws std::logic_error.
+		*/
+		index_t  mode_index() const noexcept    {return _tree.winner();}
+		count_t  mode_count() const noexcept    {return _tree.winner_count();}
+		sample_t mode()       const
+		{
+			index_t index = mode_index();
+			if (index < 0) throw std::logic_error("histogram_mode: no bins");
+			return this->binning().mid(this->index_to_coord(index));
+		}
+
+	private:
+		bool _touch(index_t index) noexcept    {_tree.update(index, this->count_at(index)); return true;}
+
+		tree_t _tree;
+	};
+}
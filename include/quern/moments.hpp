@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cmath>
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace quern
+{
+	/*
+		Moment accumulation policies for histogram_tracked.
+			Unlike the histogram, which only sees bin indexes, these hooks receive the
+			exact sample values, so mean and variance carry no binning error.  Only
+			samples the binning accepts are accumulated, keeping count() equal to the
+			tracked population.  tracked_moments_none stores nothing and its hooks
+			inline away.
+
+			insert(x)         -- x was added
+			remove(x)         -- x was removed
+			replace(x, y)     -- x was added and y removed, in one step
+			clear()           -- all samples were removed
+	*/
+	struct tracked_moments_none
+	{
+		template<typename T> void insert (const T&)           noexcept {}
+		template<typename T> void remove (const T&)           noexcept {}
+		template<typename T> void replace(const T&, const T&) noexcept {}
+		void clear() noexcept {}
+	};
+
+
+	/*
+		Running count, mean and variance, updated in O(1) per sample (Welford's method,
+			extended to removal and replacement).  Real sets the accumulator precision.
+	*/
+	template<typename Real = double>
+	struct tracked_moments
+	{
+		using real_t = Real;
+
+		template<typename T>
+		void insert(const T &sample) noexcept
+		{
+			Real x = Real(sample), d = x - _mean;
+			++_count;
+			_mean += d / Real(_count);
+			_m2   += d * (x - _mean);
+		}
+		template<typename T>
+		void remove(const T &sample) noexcept
+		{
+			if (_count <= 1) {clear(); return;}
+			Real x = Real(sample), d = x - _mean;
+			--_count;
+			_mean -= d / Real(_count);
+			_m2   -= d * (x - _mean);
+			if (_m2 < Real(0)) _m2 = Real(0);
+		}
+		template<typename T>
+		void replace(const T &new_sample, const T &old_sample) noexcept
+		{
+			if (!_count) return;
+			Real x = Real(new_sample), y = Real(old_sample), old_mean = _mean;
+			_mean += (x - y) / Real(_count);
+			_m2   += (x - y) * ((x - _mean) + (y - old_mean));
+			if (_m2 < Real(0)) _m2 = Real(0);
+		}
+		void clear() noexcept    {_count = 0; _mean = _m2 = Real(0);}
+
+		/*
+			Readouts.  variance() is the population variance; sample_variance() divides by count-1.
+		*/
+		uint64_t count()           const noexcept    {return _count;}
+		Real     mean()            const noexcept    {return _mean;}
+		Real     variance()        const noexcept    {return _count     ? _m2 / Real(_count)   : Real(0);}
+		Real     sample_variance() const noexcept    {return _count > 1 ? _m2 / Real(_count-1) : Real(0);}
+		Real     stddev()          const noexcept    {return std::sqrt(variance());}
+
+	private:
+		uint64_t _count = 0;
+		Real     _mean  = Real(0), _m2 = Real(0);
+	};
+}
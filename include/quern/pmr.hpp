@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory_resource>
+
+#include "histogram_tracked.hpp"
+
+
+/*
+	Aliases for grids, tables and histograms using polymorphic allocators.
+		Construct with a std::pmr::memory_resource* (eg, a monotonic_buffer_resource)
+		to allocate many short-lived histograms from one arena and release them together.
+*/
+
+namespace quern
+{
+	namespace pmr
+	{
+		template<typename Value>
+		using grid_storage = quern::grid_storage<Value, std::pmr::polymorphic_allocator<Value>>;
+
+		template<typename Value, size_t BlockBits = 6>
+		using grid_storage_generational = quern::grid_storage_generational<Value, BlockBits, std::pmr::polymorphic_allocator<Value>>;
+
+		template<typename Value, size_t Dimensionality>
+		using grid = quern::grid<Value, Dimensionality, pmr::grid_storage<Value>>;
+
+		template<typename Key, typename Value, typename Binning = binning<Key>>
+		using bin_table = quern::bin_table<Key, Value, Binning, pmr::grid_storage<Value>>;
+
+		template<typename Sample, typename Count = uint32_t, typename Binning = binning<Sample>>
+		using histogram = quern::histogram<Sample, Count, Binning, pmr::grid_storage<Count>>;
+
+		template<typename Sample, typename Count = uint32_t, typename Binning = binning<Sample>>
+		using histogram_tracked = quern::histogram_tracked<pmr::histogram<Sample, Count, Binning>>;
+	}
+}
@@ -111,6 +111,7 @@ namespace quern
 		for (auto i = data.begin(), e = data.end(); i != e; ++i)
 		{
 			lo.push(*i);
+			if (!hi.empty() && hi.top() < lo.top()) {hi.push(lo.top()); lo.pop(); lo.push(hi.top()); hi.pop();}
 			if (nLo > ++nTotal * quantile) {hi.push(lo.top()); lo.pop();}
 			else ++nLo;
 		}
@@ -2,6 +2,11 @@
 
 #include <algorithm>
 #include <limits>
+#include <array>
+#include <vector>
+#include <initializer_list>
+
+#include "trace.hpp"
 
 
 namespace quern
@@ -154,7 +159,7 @@ namespace quern
 		template<typename Op>
 		void for_each(const coord_t &grid_size, const Op &op) const
 		{
-			PG_TRACE;
+			QUERN_TRACE_SCOPE("grid_slice::for_each");
 
 			coord_t coord = {0};
 			for_each_sub(grid_size, op, coord, 0);
@@ -199,5 +204,5 @@ namespace quern
 				}
 			}
 		}
-	}
+	};
 }
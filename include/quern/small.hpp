@@ -0,0 +1,286 @@
+#pragma once
+
+#include <array>
+#include <variant>
+#include <stdexcept>
+#include <algorithm>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#include "histogram_tracked.hpp"
+
+
+namespace quern
+{
+	/*
+		A quantile engine for small histograms (up to MaxBins bins), which recomputes
+			every quantile from scratch instead of tracking them incrementally.
+
+			Counts live in one cache-aligned block.  Writes only increment or decrement
+			a count; the first read after a write takes a prefix sum of the block
+			(four bins per SSE2 step where available), then resolves each quantile with
+			a branch-free counting pass over the sums, which the compiler vectorizes, and
+			a second pass only when the quantile falls exactly between two bins.
+			A read costs O(bins + quantiles * bins / lanes) regardless of how far the
+			quantiles moved.
+
+		The interface and quantile records match histogram_tracked, so it may be used
+			with sliding_window.  histogram() views the block through a histogram.
+			See histogram_tracked_adaptive to choose an engine from the bin count.
+	*/
+	template<typename Sample, typename Binning = binning<Sample>, size_t MaxBins = 256>
+	class histogram_small
+	{
+	public:
+		static_assert(MaxBins > 0 && MaxBins % 16 == 0, "histogram_small bins must be a multiple of 16");
+
+		static constexpr size_t max_bins = MaxBins;
+
+		using count_t     = uint32_t;
+		using histogram_t = quern::histogram<Sample, count_t, Binning, grid_storage_view<count_t>>;
+		using sample_t    = typename histogram_t::sample_t;
+		using index_t     = typename histogram_t::index_t;
+		using binning_t   = typename histogram_t::binning_t;
+		using params_t    = typename histogram_t::params_t;
+
+		// Quantile records are those of a histogram_tracked over ordinary storage.
+		using quantile    = typename histogram_tracked<quern::histogram<Sample, count_t, Binning>>::quantile;
+		using quantiles_t = typename histogram_tracked<quern::histogram<Sample, count_t, Binning>>::quantiles_t;
+
+		static bool fits(bindex_t bins) noexcept    {return bins > 0 && size_t(bins) <= MaxBins;}
+
+	public:
+		/*
+			Set up empty bins and the quantiles to compute.
+				Throws std::length_error if the binning has more than MaxBins bins.
+		*/
+		template<typename QuantileList>
+		histogram_small(const binning_t &binning, const QuantileList &quantiles)    : _histogram(_adopt(binning)) {_init(quantiles);}
+		template<typename QuantileList>
+		histogram_small(const params_t  &params , const QuantileList &quantiles)    : _histogram(_adopt(binning_t(params))) {_init(quantiles);}
+
+		// The histogram views this object's counts, so copies re-point it.
+		histogram_small(const histogram_small &o)
+			: _counts(o._counts), _histogram(_adopt(o._histogram.binning())),
+			_population(o._population), _quantiles(o._quantiles), _stale(o._stale) {}
+		histogram_small &operator=(const histogram_small &o)
+		{
+			_counts     = o._counts;
+			_histogram  = _adopt(o._histogram.binning());
+			_population = o._population;
+			_quantiles  = o._quantiles;
+			_stale      = o._stale;
+			return *this;
+		}
+
+
+		void recalculate()    {_population = _histogram.calc_population(); _stale = true;}
+
+		void clear()
+		{
+			_counts.fill(count_t(0));
+			_population = 0;
+			_stale      = true;
+		}
+
+
+		/*
+			Access histogram and quantile readouts.
+		*/
+		const histogram_t &histogram()  const noexcept    {return _histogram;}
+		const quantiles_t &quantiles()  const noexcept    {if (_stale) _evaluate(); return _quantiles;}
+		count_t            population() const noexcept    {return _population;}
+
+
+		/*
+			Insert, remove or replace an item.
+		*/
+		void insert (sample_t new_sample)                       {insert_at_index(_histogram.index_for(new_sample));}
+		void remove (sample_t old_sample)                       {remove_at_index(_histogram.index_for(old_sample));}
+		void replace(sample_t new_sample, sample_t old_sample)    {replace_at_indexes(_histogram.index_for(new_sample), _histogram.index_for(old_sample));}
+
+		bool insert_at_index(index_t new_index) noexcept
+		{
+			bool hit = _histogram.add_at(new_index);
+			_population += hit;
+			_stale      |= hit;
+			return hit;
+		}
+		bool remove_at_index(index_t old_index) noexcept
+		{
+			bool hit = _histogram.sub_at(old_index);
+			_population -= hit;
+			_stale      |= hit;
+			return hit;
+		}
+		void replace_at_indexes(index_t new_index, index_t old_index) noexcept
+		{
+			insert_at_index(new_index);
+			remove_at_index(old_index);
+		}
+
+
+	private:
+		histogram_t _adopt(const binning_t &binning)
+		{
+			if (!fits(binning.bins())) throw std::length_error("histogram_small: too many bins");
+			return histogram_t(binning, grid_storage_view<count_t>(_counts.data(), size_t(binning.bins())));
+		}
+
+		template<typename QuantileList>
+		void _init(const QuantileList &quantiles)
+		{
+			for (auto &q : quantiles)
+			{
+				quantile_fraction<index_t> f(q);
+				if (f.den <= 0 || f.num <= 0 || f.num >= f.den) throw std::logic_error("Invalid quantile: ratio outside (0, 1)");
+				_quantiles.push_back(quantile{f, {0, _histogram.bins()-1}, 0, {}});
+			}
+		}
+
+		// Inclusive prefix sums of the first <span> counts (a multiple of 16).
+		void _prefix(count_t *sums, size_t span) const noexcept
+		{
+#if defined(__SSE2__)
+			__m128i carry = _mm_setzero_si128();
+			for (size_t i = 0; i < span; i += 4)
+			{
+				__m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(_counts.data() + i));
+				x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+				x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+				x = _mm_add_epi32(x, carry);
+				_mm_store_si128(reinterpret_cast<__m128i*>(sums + i), x);
+				carry = _mm_shuffle_epi32(x, 0xFF);
+			}
+#else
+			count_t sum = 0;
+			for (size_t i = 0; i < span; ++i) sums[i] = (sum += _counts[i]);
+#endif
+		}
+
+		/*
+			Resolve each quantile as find_quantile_indexes does:  lower is the first bin whose
+				cumulative count reaches population * num / den; if it reaches it exactly,
+				upper is the next non-empty bin (or the last), otherwise upper = lower.
+				Bins past the end (up to span) hold no samples, so their sums never
+				count below a threshold, and overshoot is clamped.
+		*/
+		void _evaluate() const noexcept
+		{
+			const index_t bins = _histogram.bins(), last = bins - 1;
+			const size_t  span = (size_t(bins) + 15) & ~size_t(15);
+
+			alignas(64) count_t sums[MaxBins];
+			_prefix(sums, span);
+
+			for (auto &q : _quantiles)
+			{
+				const uint64_t den   = uint64_t(q.quantile.den);
+				const uint64_t quota = uint64_t(_population) * uint64_t(q.quantile.num);
+				const count_t  reach = count_t((quota + den - 1) / den); // sums[i]*den < quota  <=>  sums[i] < reach
+
+				count_t below = 0;
+				for (size_t i = 0; i < span; ++i) below += (sums[i] < reach);
+				const index_t lower = std::min(index_t(below), last);
+
+				// Only an exact hit splits the quantile, across any empty bins above lower.
+				const count_t at    = sums[lower];
+				index_t       upper = lower;
+				if (uint64_t(at) * den == quota)
+				{
+					count_t through = 0;
+					for (size_t i = 0; i < span; ++i) through += (sums[i] <= at);
+					upper = std::min(index_t(through), last);
+				}
+
+				q.index_range   = {lower, upper};
+				q.samples_lower = sums[upper] - _counts[size_t(upper)];
+			}
+			_stale = false;
+		}
+
+		alignas(64) std::array<count_t, MaxBins> _counts = {};
+
+		histogram_t         _histogram;
+		count_t             _population = 0;
+		mutable quantiles_t _quantiles;
+		mutable bool        _stale = true;
+	};
+
+
+	/*
+		Quantiles of a 1-D histogram by whichever engine suits its bin count:
+			histogram_small for up to MaxBins bins, otherwise histogram_tracked.
+			The choice is made once, from the binning, at construction.
+
+		The small engine's writes are several times cheaper than tracked updates, but
+			each read after a write re-evaluates every quantile.  It wins once reads are
+			rarer than about one per 16 writes; for a read after every write, use
+			histogram_tracked directly.
+
+		Provides the sliding_window interface except histogram(), whose type differs
+			between engines; use count_at() and bins() instead.
+	*/
+	template<typename Sample, typename Binning = binning<Sample>, size_t MaxBins = 256>
+	class histogram_tracked_adaptive
+	{
+	public:
+		using small_t     = histogram_small<Sample, Binning, MaxBins>;
+		using tracked_t   = histogram_tracked<quern::histogram<Sample, uint32_t, Binning>>;
+		using histogram_t = typename tracked_t::histogram_t;
+		using sample_t    = typename tracked_t::sample_t;
+		using count_t     = typename tracked_t::count_t;
+		using index_t     = typename tracked_t::index_t;
+		using binning_t   = typename tracked_t::binning_t;
+		using params_t    = typename tracked_t::params_t;
+		using quantile    = typename tracked_t::quantile;
+		using quantiles_t = typename tracked_t::quantiles_t;
+
+		static_assert(std::is_same<quantiles_t, typename small_t::quantiles_t>::value, "engines must share quantile records");
+
+	public:
+		template<typename QuantileList>
+		histogram_tracked_adaptive(const binning_t &binning, const QuantileList &quantiles)    : _engine(_make(binning, quantiles)) {}
+		template<typename QuantileList>
+		histogram_tracked_adaptive(const params_t  &params , const QuantileList &quantiles)    : _engine(_make(binning_t(params), quantiles)) {}
+
+		/*
+			Whether the small-histogram engine was chosen.
+		*/
+		bool is_small() const noexcept    {return _engine.index() == 0;}
+
+		void recalculate()    {_visit([](auto &e) {e.recalculate();});}
+		void clear()          {_visit([](auto &e) {e.clear();});}
+
+		const quantiles_t &quantiles()  const noexcept    {return _visit([](auto &e) -> const quantiles_t& {return e.quantiles();});}
+		count_t            population() const noexcept    {return _visit([](auto &e) {return count_t(e.population());});}
+		count_t            count_at(index_t i) const      {return _visit([i](auto &e) {return count_t(e.histogram().count_at(i));});}
+		index_t            bins()       const noexcept    {return _visit([](auto &e) {return index_t(e.histogram().bins());});}
+
+		void insert (sample_t new_sample)                       {_visit([&](auto &e) {e.insert(new_sample);});}
+		void remove (sample_t old_sample)                       {_visit([&](auto &e) {e.remove(old_sample);});}
+		void replace(sample_t new_sample, sample_t old_sample)    {_visit([&](auto &e) {e.replace(new_sample, old_sample);});}
+
+	private:
+		using _engine_t = std::variant<small_t, tracked_t>;
+
+		template<typename QuantileList>
+		static _engine_t _make(const binning_t &binning, const QuantileList &quantiles)
+		{
+			if (small_t::fits(binning.bins())) return _engine_t(std::in_place_index<0>, binning, quantiles);
+			return _engine_t(std::in_place_index<1>, binning, quantiles);
+		}
+
+		// Dispatch on the engine with a branch rather than std::visit's table.
+		template<typename Func>
+		decltype(auto) _visit(Func &&func)          {return is_small() ? func(*std::get_if<0>(&_engine)) : func(*std::get_if<1>(&_engine));}
+		template<typename Func>
+		decltype(auto) _visit(Func &&func) const    {return is_small() ? func(*std::get_if<0>(&_engine)) : func(*std::get_if<1>(&_engine));}
+
+		_engine_t _engine;
+	};
+}
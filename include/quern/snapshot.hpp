@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+#include <stdint.h>
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+#include "histogram_tracked.hpp"
+#include "mapped_file.hpp"
+
+
+/*
+	Checkpoint files for histogram_tracked.
+
+	A snapshot holds the binning parameters, bin counts, population and tracked
+		quantile states of a 1-D tracker.  Saving is a single write; loading maps
+		the file and uses the counts in place, so restoring costs O(quantiles)
+		regardless of the number of bins.
+
+	Layout (version 1, native byte order):
+
+		0                 snapshot_header
+		params_offset     binning_params, raw bytes
+		quantiles_offset  snapshot_quantile[quantile_count]
+		counts_offset     count_t[bins], aligned to snapshot_alignment
+*/
+
+namespace quern
+{
+	static constexpr uint32_t snapshot_version   = 1;
+	static constexpr size_t   snapshot_alignment = 4096;
+
+	struct snapshot_header
+	{
+		char     magic[8];       // "QUERNSNP"
+		uint32_t version;
+		uint32_t header_size;
+		uint32_t sample_size, count_size, index_size, params_size;
+		uint64_t bins, population, quantile_count;
+		uint64_t params_offset, quantiles_offset, counts_offset, file_size;
+	};
+
+	struct snapshot_quantile
+	{
+		int64_t  num, den;
+		int64_t  lower, upper;
+		uint64_t samples_lower;
+	};
+
+
+	namespace detail
+	{
+		static constexpr char snapshot_magic[8] = {'Q','U','E','R','N','S','N','P'};
+
+		inline uint64_t snapshot_align(uint64_t offset)
+		{
+			return (offset + snapshot_alignment - 1) & ~uint64_t(snapshot_alignment - 1);
+		}
+
+		template<class Tracked>
+		snapshot_header snapshot_layout(uint64_t bins, uint64_t quantile_count)
+		{
+			using histogram_t = typename Tracked::histogram_t;
+
+			snapshot_header h = {};
+			std::memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+			h.version          = snapshot_version;
+			h.header_size      = sizeof(snapshot_header);
+			h.sample_size      = sizeof(typename histogram_t::sample_t);
+			h.count_size       = sizeof(typename histogram_t::count_t);
+			h.index_size       = sizeof(typename histogram_t::index_t);
+			h.params_size      = sizeof(typename histogram_t::params_t);
+			h.bins             = bins;
+			h.quantile_count   = quantile_count;
+			h.params_offset    = sizeof(snapshot_header);
+			h.quantiles_offset = h.params_offset + ((h.params_size + 7) & ~uint64_t(7));
+			h.counts_offset    = snapshot_align(h.quantiles_offset + quantile_count * sizeof(snapshot_quantile));
+			h.file_size        = h.counts_offset + bins * h.count_size;
+			return h;
+		}
+	}
+
+
+	/*
+		Save a tracker's state to a snapshot file.
+			The file is written under a temporary name, flushed to disk and renamed
+			into place, so a crash leaves either the old snapshot or the new one.
+			Throws std::runtime_error on failure.
+	*/
+	template<class Tracked>
+	void save_snapshot(const Tracked &tracked, const std::string &path)
+	{
+		using histogram_t = typename Tracked::histogram_t;
+		using params_t    = typename histogram_t::params_t;
+		using count_t     = typename histogram_t::count_t;
+
+		static_assert(std::is_trivially_copyable<params_t>::value, "snapshot requires trivially copyable binning parameters");
+		static_assert(std::is_same<typename Tracked::moments_t, tracked_moments_none>::value,
+			"snapshot does not store moments; save a tracker without a moments policy");
+		static_assert(std::is_same<typename Tracked::sums_t, tracked_sums_none>::value,
+			"snapshot does not store quantile sums; save a tracker without a sum policy");
+
+		auto &hist = tracked.histogram();
+		auto &qs   = tracked.quantiles();
+
+		snapshot_header header = detail::snapshot_layout<Tracked>(hist.bins(), qs.size());
+		header.population = tracked.population();
+
+		std::vector<char> buffer(header.file_size, 0);
+		char *base = buffer.data();
+
+		std::memcpy(base, &header, sizeof(header));
+
+		params_t params = hist.binning().params();
+		std::memcpy(base + header.params_offset, &params, sizeof(params));
+
+		auto *quantile_out = reinterpret_cast<snapshot_quantile*>(base + header.quantiles_offset);
+		for (auto &q : qs)
+		{
+			snapshot_quantile record = {
+				int64_t(q.quantile.num), int64_t(q.quantile.den),
+				int64_t(q.index_range.lower), int64_t(q.index_range.upper),
+				uint64_t(q.samples_lower)};
+			std::memcpy(quantile_out++, &record, sizeof(record));
+		}
+
+		auto *count_out = reinterpret_cast<count_t*>(base + header.counts_offset);
+		for (auto &c : hist.grid()) *(count_out++) = c;
+
+		// Write everything at once, unbuffered.
+		std::string temp = path + ".tmp";
+		std::FILE *file = std::fopen(temp.c_str(), "wb");
+		if (!file) throw std::runtime_error("snapshot: cannot create " + temp);
+		std::setvbuf(file, nullptr, _IONBF, 0);
+		bool ok = (std::fwrite(base, 1, buffer.size(), file) == buffer.size());
+		ok = ok && (std::fflush(file) == 0);
+#ifdef _WIN32
+		ok = ok && (::_commit(::_fileno(file)) == 0);
+#else
+		ok = ok && (::fsync(::fileno(file)) == 0);
+#endif
+		ok = (std::fclose(file) == 0) && ok;
+#ifdef _WIN32
+		if (ok) std::remove(path.c_str());
+#endif
+		if (!ok || std::rename(temp.c_str(), path.c_str()) != 0)
+		{
+			std::remove(temp.c_str());
+			throw std::runtime_error("snapshot: failed writing " + path);
+		}
+	}
+
+
+	/*
+		A tracker restored from a memory-mapped snapshot.
+			Counts are used in place via grid_storage_view.  The mapping is
+			copy-on-write, so the tracker may continue to accept samples
+			without modifying the file.  Throws on a missing or incompatible file.
+	*/
+	template<
+		typename Sample,
+		typename Count = uint32_t,
+		typename Binning = binning<Sample> >
+	class snapshot_mapped
+	{
+	public:
+		using histogram_t = quern::histogram<Sample, Count, Binning, grid_storage_view<Count>>;
+		using tracked_t   = histogram_tracked<histogram_t>;
+		using count_t     = typename histogram_t::count_t;
+		using params_t    = typename histogram_t::params_t;
+		using quantile_t  = typename tracked_t::quantile;
+
+		static_assert(std::is_trivially_copyable<params_t>::value, "snapshot requires trivially copyable binning parameters");
+
+	public:
+		explicit snapshot_mapped(const std::string &path)
+			: _file(path, mapped_file::COPY_ON_WRITE), _tracked(_restore(_file, path)) {}
+
+		/*
+			Access the restored tracker.
+		*/
+		const tracked_t &tracked() const noexcept    {return _tracked;}
+		tracked_t       &tracked()       noexcept    {return _tracked;}
+
+
+	private:
+		static tracked_t _restore(mapped_file &file, const std::string &path)
+		{
+			auto fail = [&](const char *why) {throw std::runtime_error("snapshot " + path + ": " + why);};
+
+			if (file.size() < sizeof(snapshot_header)) fail("truncated header");
+
+			char *base = static_cast<char*>(file.data());
+			snapshot_header h;
+			std::memcpy(&h, base, sizeof(h));
+
+			if (std::memcmp(h.magic, detail::snapshot_magic, sizeof(h.magic)) != 0) fail("not a snapshot");
+			if (h.version != snapshot_version)                                        fail("unsupported version");
+
+			// Bound the counts before computing the expected layout, so it can't overflow.
+			if (h.count_size != sizeof(count_t)
+				|| h.bins           > file.size() / sizeof(count_t)
+				|| h.quantile_count > file.size() / sizeof(snapshot_quantile))
+				fail("corrupt layout");
+
+			snapshot_header expect = detail::snapshot_layout<tracked_t>(h.bins, h.quantile_count);
+			if (h.header_size != expect.header_size
+				|| h.sample_size != expect.sample_size || h.count_size  != expect.count_size
+				|| h.index_size  != expect.index_size  || h.params_size != expect.params_size)
+				fail("incompatible sample, count or binning type");
+			if (h.params_offset != expect.params_offset || h.quantiles_offset != expect.quantiles_offset
+				|| h.counts_offset != expect.counts_offset || h.file_size != expect.file_size
+				|| file.size() < h.file_size)
+				fail("corrupt layout");
+			if (h.population > uint64_t(std::numeric_limits<count_t>::max()))
+				fail("population exceeds count type");
+
+			params_t params;
+			std::memcpy(&params, base + h.params_offset, sizeof(params));
+			Binning binning(params);
+			if (uint64_t(binning.bins()) != h.bins) fail("bin count mismatch");
+
+			typename tracked_t::quantiles_t quantiles;
+			quantiles.reserve(h.quantile_count);
+			for (uint64_t i = 0; i < h.quantile_count; ++i)
+			{
+				snapshot_quantile q;
+				std::memcpy(&q, base + h.quantiles_offset + i * sizeof(q), sizeof(q));
+				if (q.den <= 0 || q.num <= 0 || q.num >= q.den)                   fail("invalid quantile fraction");
+				if (q.lower < 0 || q.lower > q.upper || uint64_t(q.upper) >= h.bins) fail("quantile outside histogram");
+				if (q.samples_lower > h.population)                                fail("quantile count exceeds population");
+				quantiles.push_back(quantile_t{{q.num, q.den}, {q.lower, q.upper}, count_t(q.samples_lower)});
+			}
+
+			auto *counts = reinterpret_cast<count_t*>(base + h.counts_offset);
+			return tracked_t(
+				histogram_t(binning, grid_storage_view<count_t>(counts, h.bins)),
+				count_t(h.population), std::move(quantiles));
+		}
+
+		mapped_file _file;
+		tracked_t   _tracked;
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "binning.hpp"
+
+
+namespace quern
+{
+	/*
+		Per-quantile sum policies for histogram_tracked.
+			Each tracked quantile carries a quantile_state alongside samples_lower, and
+			the tracker calls it wherever samples_lower changes, including every step of
+			the adjust walk.  With tracked_sums this keeps the sum of the samples below
+			each quantile's upper bin, valued at bin midpoints, so the mean between any
+			two tracked quantiles is available in O(1) (see histogram_tracked::trimmed_mean).
+
+				add(h, bin, n)  -- n samples in bin now lie below the quantile
+				sub(h, bin, n)  -- n samples in bin no longer lie below the quantile
+				clear()         -- no samples lie below the quantile
+
+			tracked_sums_none keeps no state; its quantile_state is empty and fits in
+			the quantile record's padding.
+	*/
+	struct tracked_sums_none
+	{
+		struct quantile_state
+		{
+			template<typename H, typename C> void add(const H&, bindex_t, C) noexcept {}
+			template<typename H, typename C> void sub(const H&, bindex_t, C) noexcept {}
+			void clear() noexcept {}
+		};
+	};
+
+
+	/*
+		Sums of bin midpoints below each quantile, accumulated in Real.
+	*/
+	template<typename Real = double>
+	struct tracked_sums
+	{
+		using real_t = Real;
+
+		struct quantile_state
+		{
+			Real sum_lower = Real(0);
+
+			template<typename H, typename C>
+			void add(const H &h, bindex_t bin, C n) noexcept    {sum_lower += Real(n) * value(h, bin);}
+			template<typename H, typename C>
+			void sub(const H &h, bindex_t bin, C n) noexcept    {sum_lower -= Real(n) * value(h, bin);}
+			void clear() noexcept                               {sum_lower = Real(0);}
+		};
+
+		// The value of every sample in a bin.
+		template<typename H>
+		static Real value(const H &h, bindex_t bin) noexcept    {return Real(h.binning().mid({bin}));}
+	};
+}
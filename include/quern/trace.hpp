@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+	Compile-time tracing hooks.
+
+	Instrumentation points use QUERN_TRACE_SCOPE("name") to mark the span of the
+		enclosing scope.  Select a backend by defining one of the following before
+		including any quern header (or via the QUERN_TRACE CMake option):
+
+		(nothing)            -- tracing disabled; hooks expand to nothing
+		QUERN_TRACE_RING     -- record spans in a per-thread ring buffer (quern::trace_ring)
+		QUERN_TRACE_FTRACE   -- write begin/end markers to the Linux ftrace trace_marker,
+		                        in the format read by perfetto and catapult
+		QUERN_TRACE_SCOPE    -- define the macro yourself to use another tracer
+*/
+
+#define QUERN_TRACE_CAT_(A, B) A##B
+#define QUERN_TRACE_CAT(A, B)  QUERN_TRACE_CAT_(A, B)
+
+
+#if defined(QUERN_TRACE_SCOPE)
+	// User-supplied tracer.
+
+#elif defined(QUERN_TRACE_RING)
+
+#include <chrono>
+
+namespace quern
+{
+	/*
+		One completed span.
+	*/
+	struct trace_event
+	{
+		const char *name;
+		uint64_t    begin_ns, end_ns;
+	};
+
+	/*
+		Per-thread ring buffer holding the most recent trace_ring::capacity spans.
+	*/
+	class trace_ring
+	{
+	public:
+		static constexpr size_t capacity = size_t(1) << 14;
+
+		static trace_ring &local()    {thread_local trace_ring ring; return ring;}
+
+		static uint64_t now_ns()
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		void record(const char *name, uint64_t begin_ns, uint64_t end_ns) noexcept
+		{
+			_events[_recorded++ & (capacity-1)] = {name, begin_ns, end_ns};
+		}
+
+		// Total spans recorded, including those since overwritten.
+		uint64_t recorded() const noexcept    {return _recorded;}
+		size_t   size()     const noexcept    {return (_recorded < capacity) ? size_t(_recorded) : capacity;}
+		void     clear()          noexcept    {_recorded = 0;}
+
+		// Visit retained spans from oldest to newest.
+		template<typename Func>
+		void for_each(Func &&func) const
+		{
+			for (uint64_t i = _recorded - size(); i < _recorded; ++i) func(_events[i & (capacity-1)]);
+		}
+
+	private:
+		trace_event _events[capacity];
+		uint64_t    _recorded = 0;
+	};
+
+	struct trace_span
+	{
+		const char *name;
+		uint64_t    begin_ns;
+
+		explicit trace_span(const char *n) noexcept    : name(n), begin_ns(trace_ring::now_ns()) {}
+		~trace_span()                                  {trace_ring::local().record(name, begin_ns, trace_ring::now_ns());}
+	};
+}
+
+#define QUERN_TRACE_SCOPE(NAME) ::quern::trace_span QUERN_TRACE_CAT(_quern_trace_, __LINE__)(NAME)
+
+#elif defined(QUERN_TRACE_FTRACE)
+
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace quern
+{
+	/*
+		Writes begin/end markers to the ftrace marker file, if it can be opened.
+	*/
+	class trace_marker
+	{
+	public:
+		static int fd()
+		{
+			static int fd = _open();
+			return fd;
+		}
+
+		static void begin(const char *name) noexcept
+		{
+			if (fd() < 0) return;
+			char buffer[128];
+			int n = std::snprintf(buffer, sizeof(buffer), "B|%d|%s", int(::getpid()), name);
+			if (n > 0) (void) !::write(fd(), buffer, std::min<size_t>(size_t(n), sizeof(buffer)-1));
+		}
+		static void end() noexcept
+		{
+			if (fd() < 0) return;
+			char buffer[32];
+			int n = std::snprintf(buffer, sizeof(buffer), "E|%d", int(::getpid()));
+			if (n > 0) (void) !::write(fd(), buffer, size_t(n));
+		}
+
+	private:
+		static int _open()
+		{
+			int f = ::open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+			if (f < 0) f = ::open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+			return f;
+		}
+	};
+
+	struct trace_span
+	{
+		explicit trace_span(const char *name) noexcept    {trace_marker::begin(name);}
+		~trace_span()                                     {trace_marker::end();}
+	};
+}
+
+#define QUERN_TRACE_SCOPE(NAME) ::quern::trace_span QUERN_TRACE_CAT(_quern_trace_, __LINE__)(NAME)
+
+#else
+
+#define QUERN_TRACE_SCOPE(NAME) ((void) 0)
+
+#endif
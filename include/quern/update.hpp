@@ -0,0 +1,29 @@
+#pragma once
+
+
+namespace quern
+{
+	/*
+		Update policies for histogram_tracked, deciding when quantiles are walked.
+
+			tracked_update_eager  -- every insert, remove or replace adjusts each quantile
+			                         (the default)
+			tracked_update_lazy   -- writes update bin counts and each quantile's
+			                         samples_lower (and sums) only; the first read after a
+			                         write walks each quantile once from where it was left
+
+		Lazy updates suit streams with many writes per read:  each write costs one
+			comparison per quantile, and the walking is paid once per read, over the
+			net distance the quantiles moved.  Reads through quantiles() and
+			trimmed_mean() catch up automatically.
+	*/
+	struct tracked_update_eager
+	{
+		static constexpr bool lazy = false;
+	};
+
+	struct tracked_update_lazy
+	{
+		static constexpr bool lazy = true;
+	};
+}
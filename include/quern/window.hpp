@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "histogram_tracked.hpp"
+
+
+namespace quern
+{
+	/*
+		Extrema policies for sliding_window.
+			The window calls push(ring, slot, evicted) after writing a sample to ring[slot];
+			<evicted> is true if that overwrote the oldest sample.
+
+			window_extrema_none tracks nothing.
+	*/
+	struct window_extrema_none
+	{
+		void resize(size_t) noexcept {}
+		void clear()        noexcept {}
+		template<typename Ring> void push(const Ring&, size_t, bool) noexcept {}
+	};
+
+
+	/*
+		Exact window minimum and maximum, by monotonic deques of ring slots.
+			The deques hold slots rather than values, so samples live only in the window's
+			ring.  Each push costs O(1) amortized; min_slot() and max_slot() are O(1).
+			Unlike the histogram, this sees every sample, including those outside the binning.
+	*/
+	template<typename Sample>
+	class window_extrema
+	{
+	public:
+		void resize(size_t capacity)          {_min.resize(capacity); _max.resize(capacity);}
+		void clear()                noexcept    {_min.clear(); _max.clear();}
+
+		template<typename Ring>
+		void push(const Ring &ring, size_t slot, bool evicted)
+		{
+			auto &x = ring[slot];
+			_min.push(slot, evicted, [&](size_t back) {return !(ring[back] < x);});
+			_max.push(slot, evicted, [&](size_t back) {return !(x < ring[back]);});
+		}
+
+		size_t min_slot() const noexcept    {return _min.front();}
+		size_t max_slot() const noexcept    {return _max.front();}
+
+	private:
+		// Circular deque of ring slots, oldest at the front.
+		struct _deque
+		{
+			std::vector<size_t> slots;
+			size_t              head = 0, count = 0;
+
+			void resize(size_t capacity)          {slots.assign(capacity, 0); head = count = 0;}
+			void clear()                noexcept    {head = count = 0;}
+
+			size_t front() const noexcept    {return slots[head];}
+
+			template<typename Dominated>
+			void push(size_t slot, bool evicted, Dominated &&dominated)
+			{
+				size_t n = slots.size();
+				if (!n) return;
+
+				// The oldest sample expired; it can only be at the front.
+				if (evicted && count && slots[head] == slot) {if (++head == n) head = 0; --count;}
+
+				// Drop samples the new one outlasts and equals or beats.
+				while (count)
+				{
+					size_t back = head + count - 1;
+					if (back >= n) back -= n;
+					if (!dominated(slots[back])) break;
+					--count;
+				}
+
+				size_t end = head + count;
+				slots[(end >= n) ? end - n : end] = slot;
+				++count;
+			}
+		};
+
+		_deque _min, _max;
+	};
+
+
+	/*
+		A sliding window over the most recent samples, with quantiles tracked by a histogram_tracked.
+			Samples are kept in a ring buffer.  Until the window is full, pushes insert;
+			afterwards each push replaces the oldest sample.
+
+		T_Extrema  -- extrema policy; window_extrema<sample_t> enables min() and max()
+	*/
+	template<class T_Tracked, class T_Extrema = window_extrema_none>
+	class sliding_window
+	{
+	public:
+		using tracked_t   = T_Tracked;
+		using histogram_t = typename tracked_t::histogram_t;
+		using sample_t    = typename tracked_t::sample_t;
+		using count_t     = typename tracked_t::count_t;
+		using extrema_t   = T_Extrema;
+
+	public:
+		/*
+			Create a window holding up to <capacity> samples.
+				Remaining arguments are forwarded to the tracker's constructor.
+		*/
+		template<typename... Args>
+		explicit sliding_window(size_t capacity, Args&&... tracked_args)
+			: _tracked(std::forward<Args>(tracked_args)...), _ring(capacity), _head(0), _size(0) {_extrema.resize(capacity);}
+
+		/*
+			Add a sample, evicting the oldest if the window is full.
+		*/
+		void push(const sample_t &sample)
+		{
+			if (_size < _ring.size())
+			{
+				size_t slot = _head + _size;
+				if (slot >= _ring.size()) slot -= _ring.size();
+				_ring[slot] = sample;
+				++_size;
+				_extrema.push(_ring, slot, false);
+				_tracked.insert(sample);
+			}
+			else if (_size)
+			{
+				size_t slot = _head;
+				sample_t old = _ring[slot];
+				_ring[slot] = sample;
+				if (++_head == _ring.size()) _head = 0;
+				_extrema.push(_ring, slot, true);
+				_tracked.replace(sample, old);
+			}
+		}
+
+		void push(const sample_t *samples, size_t count)
+		{
+			QUERN_TRACE_SCOPE("sliding_window::push");
+			for (size_t i = 0; i < count; ++i) push(samples[i]);
+		}
+
+		/*
+			Empty the window.
+		*/
+		void clear()
+		{
+			_head = _size = 0;
+			_extrema.clear();
+			_tracked.clear();
+		}
+
+		/*
+			Access the window state.
+		*/
+		const tracked_t   &tracked()   const noexcept    {return _tracked;}
+		const histogram_t &histogram() const noexcept    {return _tracked.histogram();}
+		decltype(auto)     quantiles() const noexcept    {return _tracked.quantiles();}
+
+		size_t size    () const noexcept    {return _size;}
+		size_t capacity() const noexcept    {return _ring.size();}
+		bool   full    () const noexcept    {return _size == _ring.size();}
+
+		/*
+			Exact smallest and largest samples in the window, with an extrema policy.
+				The window must not be empty.
+		*/
+		const sample_t  &min()     const    {return _ring[_extrema.min_slot()];}
+		const sample_t  &max()     const    {return _ring[_extrema.max_slot()];}
+		const extrema_t &extrema() const noexcept    {return _extrema;}
+
+		// Access the i'th oldest sample in the window.
+		const sample_t &operator[](size_t i) const
+		{
+			size_t slot = _head + i;
+			return _ring[(slot >= _ring.size()) ? slot - _ring.size() : slot];
+		}
+
+
+	private:
+		tracked_t             _tracked;
+		std::vector<sample_t> _ring;
+		size_t                _head, _size;
+		extrema_t             _extrema;
+	};
+}
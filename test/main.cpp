@@ -3,8 +3,21 @@
 #include <string>
 #include <array>
 #include <deque>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
 
 #include <quern/histogram_tracked.hpp>
+#include <quern/histogram_tracked_static.hpp>
+#include <quern/pmr.hpp>
+#include <quern/snapshot.hpp>
+#include <quern/histogram_marginals.hpp>
+#include <quern/window.hpp>
+#include <quern/mad.hpp>
+#include <quern/mode.hpp>
+#include <quern/dirty.hpp>
+#include <quern/small.hpp>
 
 
 using namespace quern::literals;
@@ -30,23 +43,35 @@ quern::quantile_fraction<> p_quantiles[] =
 };
 
 
-using Histogram32 = quern::histogram<float>;
+using Histogram32    = quern::histogram<float>;
+using Histogram32Gen = quern::histogram<float, uint32_t, quern::binning<float>, quern::grid_storage_generational<uint32_t, 2>>;
 
 
-struct QuantileTester :
-	public quern::histogram_tracked<Histogram32>
+/*
+	Checks failed over the whole run.  --batch exits nonzero if any failed.
+*/
+static size_t failed_checks = 0;
+
+
+template<class Histogram>
+struct QuantileTester_ :
+	public quern::histogram_tracked<Histogram, quern::tracked_instrument_counters>
 {
 public:
-	using histogram_t = Histogram32;
-	using histogram_tracked = quern::histogram_tracked<Histogram32>;
+	using histogram_t = Histogram;
+	using histogram_tracked = quern::histogram_tracked<Histogram, quern::tracked_instrument_counters>;
+	using histogram_tracked::histogram;
+	using histogram_tracked::quantiles;
+	using histogram_tracked::population;
+	using histogram_tracked::instrument;
 	
-	QuantileTester() :
+	QuantileTester_() :
 		histogram_tracked(quern::binning_params<float>{0.f, 32.f, 32})
 	{
 		histogram_tracked::add_quantiles(p_quantiles);
 	}
 
-	~QuantileTester()
+	~QuantileTester_()
 	{
 	}
 
@@ -87,6 +112,7 @@ public:
 		bool printedHeading = false;
 		auto printHeading = [&]()
 		{
+			++failed_checks;
 			if (!printedHeading)
 				std::cout << "\tConsistency Checks (" << context
 					<< "): population " << population() << std::endl;
@@ -124,6 +150,22 @@ public:
 			}
 
 
+			// Cached rank thresholds match the population
+			for (auto &q : quantiles())
+			{
+				size_t lte = size_t(population()) * size_t(q.quantile.num);
+				size_t gte = size_t(population()) * size_t(q.quantile.den - q.quantile.num);
+
+				if (q.lte_target != lte || q.gte_target != gte)
+				{
+					printHeading();
+					std::cout << "\t\tInconsistency at " << q.quantile.num << "/" << q.quantile.den
+						<< " rank targets are " << q.lte_target << "," << q.gte_target
+						<< " but should be " << lte << "," << gte << std::endl;
+				}
+			}
+
+
 			// Correct quantile values
 			for (auto &q : quantiles())
 			{
@@ -139,7 +181,6 @@ public:
 					std::cout << "\t\tBad quantile " << q.quantile.num << "/" << q.quantile.den
 						<< " .. location is " << q.index_range.lower << ":" << q.index_range.upper
 						<< " but histogram evaluates to " << expected.lower << ":" << expected.upper
-						<< " ... last adjust " << q.last_adjust
 						<< std::endl;
 				}
 			}
@@ -158,16 +199,76 @@ public:
 					<< " " << std::setw(3) << q.index_range.lower << ":"
 					<< std::left << std::setw(3) << q.index_range.upper << std::right
 					<< " samples_lower = " << q.samples_lower
-					<< " ... last adjust " << q.last_adjust
 					<< std::endl;
 			}
 
+			auto &stats = instrument();
+			std::cout << "\tAdjusts: " << stats.adjusts_up << " up, " << stats.adjusts_down << " down, "
+				<< stats.adjusts_inplace << " in place; " << stats.bins_walked << " bins walked, "
+				<< stats.empty_skips << " empty skips, " << stats.splits << " splits, "
+				<< stats.rejects << " rejects" << std::endl;
+
 			std::cout << "\t**********" << std::endl;
 		}
 #endif
 	}
 };
 
+using QuantileTester = QuantileTester_<Histogram32>;
+
+
+/*
+	Counts mismatches between a structure under test and a reference, for tests
+		which don't fit consistencyCheck.  report() prints one line, which ctest
+		watches for, and adds the mismatches to failed_checks.
+*/
+struct MismatchTally
+{
+	const char *subject;
+	size_t      mismatches = 0;
+
+	explicit MismatchTally(const char *_subject) : subject(_subject) {}
+
+	void expect(bool ok)    {mismatches += !ok;}
+
+	// Quantile records agree on bin ranges (and optionally samples_lower), in order.
+	template<class QuantilesA, class QuantilesB>
+	void same_quantiles(const QuantilesA &a, const QuantilesB &b, bool samples_lower = true)
+	{
+		if (a.size() != b.size()) {++mismatches; return;}
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			expect(a[i].index_range.lower == b[i].index_range.lower && a[i].index_range.upper == b[i].index_range.upper);
+			if (samples_lower) expect(a[i].samples_lower == b[i].samples_lower);
+		}
+	}
+
+	// Quantile records agree with find_quantile_indexes over a histogram.
+	template<class Quantiles, class Histogram>
+	void found_in(const Quantiles &quantiles, const Histogram &hist)
+	{
+		for (auto &q : quantiles)
+		{
+			auto expected = find_quantile_indexes(hist, q.quantile);
+			expect(expected.lower == q.index_range.lower && expected.upper == q.index_range.upper);
+		}
+	}
+
+	// Histograms hold the same counts, bin for bin.
+	template<class HistogramA, class HistogramB>
+	void same_counts(const HistogramA &a, const HistogramB &b)
+	{
+		if (ptrdiff_t(a.bins()) != ptrdiff_t(b.bins())) {++mismatches; return;}
+		for (ptrdiff_t i = 0; i < ptrdiff_t(a.bins()); ++i) expect(a.count_at(i) == b.count_at(i));
+	}
+
+	void report()
+	{
+		if (mismatches) std::cout << "\t\t" << subject << " inconsistent in " << mismatches << " places" << std::endl;
+		failed_checks += mismatches;
+	}
+};
+
 
 int main(int argc, char **argv)
 {
@@ -262,6 +363,623 @@ int main(int argc, char **argv)
 		}
 	}
 
+	for (size_t pop = 10; pop < 1000; pop *= 3)
+	{
+		std::cout << "TEST: tumbling windows with generational storage, population " << pop << std::endl;
+
+		{
+			QuantileTester_<Histogram32Gen> test;
+
+			for (size_t window = 0; window < 20; ++window)
+			{
+				test.clear();
+				test.consistencyCheck("tumbling window, cleared");
+
+				for (size_t i = 0; i < pop; ++i)
+				{
+					size_t x = size_t(rand()) % (1 + window);
+					test.insert(x);
+					test.consistencyCheck("tumbling window, fill");
+				}
+			}
+
+			test.print();
+		}
+	}
+
+	{
+		std::cout << "TEST: quantiles added to a populated tracker" << std::endl;
+
+		QuantileTester test;
+		quern::quantile_fraction<> more[] = {1/3_quo, 2/3_quo, 7/8_quo};
+		std::vector<float> samples;
+		for (size_t i = 0; i < 300; ++i) {samples.push_back(float(rand() & 31)); test.insert(samples.back());}
+		test.add_quantiles(more);
+		test.consistencyCheck("added quantiles");
+		for (size_t i = 0; i < 100; ++i) test.remove(samples[i]);
+		test.consistencyCheck("added quantiles, removal");
+		test.clear();
+		test.consistencyCheck("added quantiles, cleared");
+	}
+
+	{
+		std::cout << "TEST: 1000 trackers allocated from a monotonic arena" << std::endl;
+
+		std::pmr::monotonic_buffer_resource arena;
+		std::vector<quern::pmr::histogram_tracked<float>> trackers;
+		trackers.reserve(1000);
+
+		for (size_t i = 0; i < 1000; ++i)
+			trackers.emplace_back(quern::binning_params<float>{0.f, 32.f, 32}, p_quantiles, &arena);
+
+		MismatchTally tally("Arena-allocated trackers");
+		for (auto &t : trackers)
+		{
+			for (size_t i = 0; i < 50; ++i) t.insert(float(rand() & 31));
+			tally.found_in(t.quantiles(), t.histogram());
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: snapshot save and mapped restore" << std::endl;
+
+		QuantileTester live;
+		for (size_t i = 0; i < 500; ++i) live.insert(float(rand() & 31));
+
+		const char *path = "quern_test_snapshot.bin";
+		quern::save_snapshot(live, path);
+
+		{
+			quern::snapshot_mapped<float> restored(path);
+			auto &tracked = restored.tracked();
+
+			MismatchTally tally("Restored snapshot");
+			for (size_t i = 0; i < 500; ++i)
+			{
+				float x = float(rand() & 31), y = float(rand() & 31);
+				live.replace(x, y);
+				tracked.replace(x, y);
+			}
+			tally.expect(tracked.population() == live.population());
+			tally.same_quantiles(live.quantiles(), tracked.quantiles());
+			tally.same_counts(live.histogram(), tracked.histogram());
+			tally.report();
+		}
+
+		// Corrupted headers and quantile records must be refused, not mapped.
+		{
+			auto corrupt = [&](size_t offset, const void *bytes, size_t size) -> bool
+			{
+				quern::save_snapshot(live, path);
+				std::FILE *f = std::fopen(path, "r+b");
+				std::fseek(f, long(offset), SEEK_SET);
+				std::fwrite(bytes, 1, size, f);
+				std::fclose(f);
+				try {quern::snapshot_mapped<float> restored(path);}
+				catch (std::runtime_error&) {return true;}
+				return false;
+			};
+			uint64_t far_offset = uint64_t(1) << 40;
+			int64_t  bad_upper  = 1000000;
+			size_t quantiles_at = sizeof(quern::snapshot_header) + ((sizeof(quern::binning_params<float>) + 7) & ~size_t(7));
+
+			MismatchTally tally("Corrupt snapshot refusal");
+			tally.expect(corrupt(offsetof(quern::snapshot_header, quantiles_offset), &far_offset, sizeof(far_offset)));
+			tally.expect(corrupt(offsetof(quern::snapshot_header, params_offset),    &far_offset, sizeof(far_offset)));
+			tally.expect(corrupt(quantiles_at + offsetof(quern::snapshot_quantile, upper), &bad_upper, sizeof(bad_upper)));
+			tally.report();
+		}
+		std::remove(path);
+	}
+
+	{
+		std::cout << "TEST: marginal quantiles of complex samples in a sliding window" << std::endl;
+
+		using Complex     = std::complex<float>;
+		using HistogramC  = quern::histogram<Complex>;
+		using Marginals   = quern::histogram_marginals<HistogramC>;
+
+		quern::sliding_window<Marginals> window(300,
+			HistogramC::params_t{{0.f, 32.f, 32}, {0.f, 16.f, 16}}, p_quantiles);
+		QuantileTester re;
+		quern::histogram_tracked<Histogram32> im(quern::binning_params<float>{0.f, 16.f, 16}, p_quantiles);
+		std::deque<Complex> log;
+
+		MismatchTally tally("Marginal quantiles");
+		for (size_t i = 0; i < 3000; ++i)
+		{
+			// Occasional samples fall outside the imaginary axis and are rejected on both axes.
+			Complex x(float(rand() & 31), float(rand() % 20));
+			window.push(x);
+			log.push_back(x);
+			if (x.imag() < 16.f) {re.insert(x.real()); im.insert(x.imag());}
+			if (log.size() > window.capacity())
+			{
+				Complex old = log.front(); log.pop_front();
+				if (old.imag() < 16.f) {re.remove(old.real()); im.remove(old.imag());}
+			}
+
+			auto &m = window.tracked();
+			tally.expect(m.population() == re.population() && m.population() == m.histogram().calc_population());
+			tally.same_quantiles(m.quantiles<0>(), re.quantiles(), false);
+			tally.same_quantiles(m.quantiles<1>(), im.quantiles(), false);
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: incremental moments in a sliding window" << std::endl;
+
+		using TrackedMoments = quern::histogram_tracked<Histogram32, quern::tracked_instrument_none, quern::tracked_moments<double>>;
+		quern::sliding_window<TrackedMoments> window(500, quern::binning_params<float>{0.f, 32.f, 32}, p_quantiles);
+
+		MismatchTally tally("Moments");
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			// Some samples fall outside the binning; these are excluded from the moments.
+			window.push(float(rand() % 40) + .25f);
+
+			if (i % 97) continue;
+			double sum = 0, sum2 = 0;
+			size_t n = 0;
+			for (size_t j = 0; j < window.size(); ++j) if (window[j] < 32.f) {sum += window[j]; ++n;}
+			double mean = n ? sum / n : 0;
+			for (size_t j = 0; j < window.size(); ++j) if (window[j] < 32.f) sum2 += (window[j]-mean) * (window[j]-mean);
+
+			auto &m = window.tracked().moments();
+			tally.expect(m.count() == n && m.count() == window.tracked().population());
+			tally.expect(std::abs(m.mean() - mean) <= 1e-9 && std::abs(m.variance() - (n ? sum2 / n : 0)) <= 1e-6);
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: trimmed means from per-quantile sums" << std::endl;
+
+		using TrackedSums = quern::histogram_tracked<Histogram32,
+			quern::tracked_instrument_none, quern::tracked_moments_none, quern::tracked_sums<double>>;
+		quern::sliding_window<TrackedSums> window(400, quern::binning_params<float>{0.f, 32.f, 32}, p_quantiles);
+
+		// Pairs of indexes into p_quantiles:  interquartile, 10% trimmed, 1%..95%.
+		const size_t pairs[][2] = {{3, 6}, {2, 7}, {0, 8}};
+
+		MismatchTally tally("Trimmed means");
+		std::vector<double> mids;
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			window.push(float(rand() % 36) + float(rand() % 100) * .01f);
+
+			if (i % 89) continue;
+			mids.clear();
+			for (size_t j = 0; j < window.size(); ++j) if (window[j] < 32.f) mids.push_back(std::floor(window[j]) + .5);
+			std::sort(mids.begin(), mids.end());
+
+			auto &t = window.tracked();
+			for (auto &p : pairs)
+			{
+				// Reference:  mean of the sorted bin midpoints between fractional ranks.
+				double ra = mids.size() * double(p_quantiles[p[0]]), rb = mids.size() * double(p_quantiles[p[1]]), sum = 0;
+				for (size_t k = 0; k < mids.size(); ++k)
+					sum += mids[k] * std::max(0.0, std::min(rb, k+1.0) - std::max(ra, double(k)));
+				double expect = (rb > ra) ? sum / (rb - ra) : 0.0, got = t.trimmed_mean(p[0], p[1]);
+				tally.expect(rb > ra ? std::abs(got - expect) < 1e-9 : std::isnan(got));
+			}
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: median absolute deviation in a sliding window" << std::endl;
+
+		using TrackedMAD = quern::histogram_tracked_mad<quern::histogram_tracked<Histogram32>>;
+		quern::sliding_window<TrackedMAD> window(300, quern::binning_params<float>{0.f, 64.f, 64}, p_quantiles);
+
+		MismatchTally tally("MAD");
+		std::vector<ptrdiff_t> dist;
+		for (size_t i = 0; i < 30000; ++i)
+		{
+			// Spread changes over time, so the median and MAD both move.
+			float spread = float(1 + (i / 3000) % 8);
+			window.push(float(rand() % 70) * (i & 1) + (20.f + float(rand() % 9) * spread) * !(i & 1));
+
+			// Reference:  median of the half-bin distances from the center of the median's bins.
+			auto &t = window.tracked();
+			ptrdiff_t center2 = t.median().index_range.lower + t.median().index_range.upper;
+			dist.clear();
+			for (size_t j = 0; j < window.size(); ++j)
+				if (window[j] < 64.f) dist.push_back(std::abs(2*ptrdiff_t(window[j]) - center2));
+			std::sort(dist.begin(), dist.end());
+			ptrdiff_t expect = dist.empty() ? 0 : dist[(dist.size()+1)/2 - 1];
+
+			tally.expect(t.radius() == expect && t.quantiles().size() == std::size(p_quantiles) + 1);
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: tracked mode under sliding and discrete updates" << std::endl;
+
+		using TrackedMode = quern::histogram_tracked<quern::histogram_mode<Histogram32>>;
+		quern::sliding_window<TrackedMode> window(200, quern::binning_params<float>{0.f, 32.f, 32}, p_quantiles);
+		QuantileTester reference;
+		std::deque<float> log;
+
+		enum Level : int {LEVEL_MIN = -5, LEVEL_MAX = 10};
+		quern::histogram_mode<quern::histogram<Level>> discrete(quern::binning_params<Level>{LEVEL_MIN, LEVEL_MAX});
+		std::deque<Level> discrete_log;
+
+		// Reference:  the first fullest bin, by scanning.
+		auto argmax = [](auto &h)
+		{
+			ptrdiff_t best = 0;
+			for (ptrdiff_t i = 1; i < ptrdiff_t(h.bins()); ++i) if (h.count_at(i) > h.count_at(best)) best = i;
+			return best;
+		};
+
+		MismatchTally tally("Mode");
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			// Skewed toward a drifting center, with some samples out of range.
+			float x = float((rand() % 8) * (rand() % 8) / 4 + (i / 1000) % 24) + float(rand() % 4) * 3.f;
+			window.push(x);
+			log.push_back(x);
+			reference.insert(x);
+			if (log.size() > window.capacity()) {reference.remove(log.front()); log.pop_front();}
+
+			auto &h = window.histogram();
+			tally.expect(h.mode_index() == argmax(h) && h.mode_count() == h.count_at(argmax(h)));
+			tally.same_quantiles(window.quantiles(), reference.quantiles());
+
+			Level v = Level(rand() % 18 - 6);
+			discrete.add(v);
+			discrete_log.push_back(v);
+			if (discrete_log.size() > 50) {discrete.sub(discrete_log.front()); discrete_log.pop_front();}
+			tally.expect(discrete.mode_index() == argmax(discrete) && int(discrete.mode()) == LEVEL_MIN + argmax(discrete));
+		}
+
+		// With no bins there is no mode.
+		quern::histogram_mode<Histogram32> unbinned;
+		tally.expect(unbinned.mode_index() == -1);
+		try {unbinned.mode(); tally.expect(false);}
+		catch (std::logic_error&) {}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: exact window extrema" << std::endl;
+
+		using Window = quern::sliding_window<quern::histogram_tracked<Histogram32>, quern::window_extrema<float>>;
+		Window window(150, quern::binning_params<float>{0.f, 32.f, 32}, p_quantiles);
+
+		MismatchTally tally("Window extrema");
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			// Includes samples outside the binning, and a clear partway through.
+			if (i == 7000) window.clear();
+			window.push(float(rand() % 4000) * .01f - 4.f + float((i / 500) % 5));
+
+			float lo = window[0], hi = window[0];
+			for (size_t j = 1; j < window.size(); ++j) {lo = std::min(lo, window[j]); hi = std::max(hi, window[j]);}
+			tally.expect(window.min() == lo && window.max() == hi);
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: batched multivariate binning" << std::endl;
+
+		enum Channel : int {CHANNEL_MIN = 0, CHANNEL_MAX = 5};
+		using Sample3 = std::tuple<float, float, Channel>;
+		quern::histogram<Sample3> h3(quern::histogram<Sample3>::params_t{{-1.f, 1.f, 20}, {0.f, 10.f, 7}, {CHANNEL_MIN, CHANNEL_MAX}});
+		quern::histogram<std::complex<float>> h2(quern::histogram<std::complex<float>>::params_t{{0.f, 32.f, 32}, {0.f, 16.f, 16}});
+
+		// Sizes straddle the internal chunk size; some samples fall outside each axis.
+		const size_t count = 1000;
+		std::vector<float>   xs(count), ys(count);
+		std::vector<Channel> cs(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			xs[i] = float(rand() % 2400) * .001f - 1.2f;
+			ys[i] = float(rand() % 1100) * .01f;
+			cs[i] = Channel(rand() % 7 - 1);
+		}
+
+		MismatchTally tally("Batched binning");
+		std::vector<ptrdiff_t> indexes(count), cx(count), cy(count), cz(count);
+		h3.binning().index_batch(indexes.data(), count, xs.data(), ys.data(), cs.data());
+		h3.binning().coord_batch({cx.data(), cy.data(), cz.data()}, count, xs.data(), ys.data(), cs.data());
+		for (size_t i = 0; i < count; ++i)
+		{
+			Sample3 v(xs[i], ys[i], cs[i]);
+			auto c = h3.coord_for(v);
+			tally.expect(indexes[i] == h3.index_for(v) && cx[i] == c[0] && cy[i] == c[1] && cz[i] == c[2]);
+		}
+
+		h2.binning().index_batch(indexes.data(), count - 3, xs.data(), ys.data());
+		for (size_t i = 0; i < count - 3; ++i)
+			tally.expect(indexes[i] == h2.index_for(std::complex<float>(xs[i], ys[i])));
+
+		// A multi-dof element can't be batched as one column; its scalar columns can.
+		using Nested = std::tuple<std::complex<float>, float>;
+		using Flat   = std::tuple<float, float, float>;
+		static_assert(!quern::binning<Nested>::batchable && quern::binning<Flat>::batchable && quern::binning<Sample3>::batchable,
+			"batchable must require one degree of freedom per element");
+		quern::binning<Flat> flat(quern::binning<Flat>::params_t{{0.f, 32.f, 32}, {0.f, 16.f, 16}, {-1.f, 1.f, 20}});
+		flat.index_batch(indexes.data(), count, xs.data(), ys.data(), xs.data());
+		flat.coord_batch({cx.data(), cy.data(), cz.data()}, count, xs.data(), ys.data(), xs.data());
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto c = flat.coord(Flat(xs[i], ys[i], xs[i]));
+			bool in = (c[0] >= 0 && c[1] >= 0 && c[2] >= 0);
+			tally.expect(indexes[i] == (in ? (c[0] * 16 + c[1]) * 20 + c[2] : quern::BIN_REJECT));
+			tally.expect(cx[i] == c[0] && cy[i] == c[1] && cz[i] == c[2]);
+		}
+
+		// NaN is rejected by both paths, and bins beyond float's exact integers fall back to index().
+		const float odd[] = {std::nanf(""), -std::nanf(""), 0.f, 1.f, std::nextafter(1.f, 0.f), .5f, -0.f, 2.f};
+		for (ptrdiff_t bins : {ptrdiff_t(20), ptrdiff_t(1) << 24, (ptrdiff_t(1) << 24) + 1, ptrdiff_t(INT32_MAX)})
+		{
+			quern::binning<float> rule(quern::binning_params<float>{0.f, 1.f, bins});
+			rule.index_batch(indexes.data(), std::size(odd), odd);
+			for (size_t i = 0; i < std::size(odd); ++i)
+				tally.expect(indexes[i] == rule.index(odd[i]) && (indexes[i] == quern::BIN_REJECT || indexes[i] < bins));
+		}
+		tally.expect(quern::binning<float>(quern::binning_params<float>{0.f, 1.f, 20}).index(std::nanf("")) == quern::BIN_REJECT);
+
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: columnar ingestion" << std::endl;
+
+		enum Channel : int {CHANNEL_MIN = 0, CHANNEL_MAX = 5};
+		using Sample3 = std::tuple<float, float, Channel>;
+		using H3      = quern::histogram<Sample3>;
+		const H3::params_t params{{-1.f, 1.f, 20}, {0.f, 10.f, 7}, {CHANNEL_MIN, CHANNEL_MAX}};
+		H3 columnar(params), rows(params);
+		quern::histogram_mode<Histogram32> columnar1(quern::binning_params<float>{0.f, 32.f, 32}), rows1(columnar1.binning());
+
+		const size_t count = 1500;
+		std::vector<float>   xs(count), ys(count);
+		std::vector<Channel> cs(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			xs[i] = float(rand() % 2400) * .001f - 1.2f;
+			ys[i] = float(rand() % 1100) * .01f;
+			cs[i] = Channel(rand() % 7 - 1);
+		}
+
+		// Add everything, then subtract a prefix that straddles a batch boundary.
+		size_t hits = columnar.add_columns(count, xs.data(), ys.data(), cs.data()), expect = 0;
+		for (size_t i = 0; i < count; ++i) expect += rows.add(Sample3(xs[i], ys[i], cs[i]));
+		hits   -= columnar.sub_columns(300, xs.data(), ys.data(), cs.data());
+		for (size_t i = 0; i < 300; ++i) expect -= rows.sub(Sample3(xs[i], ys[i], cs[i]));
+
+		hits   += columnar1.add_columns(count, ys.data());
+		for (size_t i = 0; i < count; ++i) expect += rows1.add(ys[i]);
+
+		MismatchTally tally("Columnar ingestion");
+		tally.expect(hits == expect);
+		tally.same_counts(columnar, rows);
+		tally.same_counts(columnar1, rows1);
+		tally.expect(columnar1.mode_index() == rows1.mode_index());
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: bulk fill strategies" << std::endl;
+
+		const quern::binning_params<float> params{0.f, 1.f, 300000};
+		const size_t count = 200000;
+		std::vector<float>     xs(count);
+		std::vector<ptrdiff_t> indexes(count);
+		for (size_t i = 0; i < count; ++i) xs[i] = float(rand() % 110000) * 1e-5f - .05f;
+
+		Histogram32 reference(params);
+		reference.index_for_columns(indexes.data(), count, xs.data());
+		size_t expect = reference.add_indexes(indexes.data(), count, 2);
+
+		MismatchTally tally("Bulk fill");
+		for (auto strategy : {quern::FILL_DIRECT, quern::FILL_PREFETCH, quern::FILL_PARTITION, quern::FILL_AUTO})
+		{
+			Histogram32 h(params);
+			tally.expect(h.fill_indexes(indexes.data(), count, 2, strategy) == expect);
+			tally.same_counts(h, reference);
+		}
+
+		quern::histogram_mode<Histogram32> moded(params);
+		tally.expect(moded.fill_columns(count, xs.data()) == expect);
+		moded.fill_columns(count, xs.data());
+		tally.same_counts(moded, reference);
+		tally.expect(moded.mode_count() == *std::max_element(reference.begin(), reference.end()));
+
+		// Small grids fill directly; a large grid is partitioned under dense batches and prefetched otherwise.
+		Histogram32 large(quern::binning_params<float>{0.f, 1.f, 1 << 21});
+		tally.expect(Histogram32(quern::binning_params<float>{0.f, 1.f, 1024}).choose_fill(count) == quern::FILL_DIRECT);
+		tally.expect(large.choose_fill(size_t(1) << 23) == quern::FILL_PARTITION);
+		tally.expect(large.choose_fill(size_t(1) << 20) == quern::FILL_PREFETCH);
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: dirty-bin delta export" << std::endl;
+
+		using Tracked = quern::histogram_tracked<quern::histogram_dirty<Histogram32>>;
+		const quern::binning_params<float> params{0.f, 32.f, 4096};
+		quern::sliding_window<Tracked> window(300, params, p_quantiles);
+		Histogram32 replica(params);
+		std::vector<Tracked::histogram_t::delta_cell_t> delta;
+
+		MismatchTally tally("Dirty-bin delta");
+		size_t hop = 50;
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			// Out-of-range samples, and a clear that forces a complete delta.
+			if (i == 9000) window.clear();
+			window.push(float(rand() % 3400) * .01f - 1.f);
+			if ((i + 1) % hop) continue;
+
+			auto &h = window.histogram();
+			tally.expect(i == 9000 + hop - 1 || h.dirty_count() <= 2 * hop);
+			delta.clear();
+			size_t cells = h.export_delta(std::back_inserter(delta));
+			tally.expect(quern::apply_delta(replica, delta.data(), delta.size()) == cells);
+			h.checkpoint();
+			tally.expect(h.dirty_count() == 0);
+			tally.same_counts(replica, h);
+		}
+
+		// Marking never reallocates the change list, including in copies, so tracked updates stay noexcept.
+		static_assert(noexcept(std::declval<Tracked::histogram_t&>().add_at(ptrdiff_t(0))), "marking must not throw");
+		Tracked::histogram_t copy = window.histogram();
+		copy.checkpoint();
+		const ptrdiff_t *list = copy.dirty_begin();
+		for (ptrdiff_t j = 0; j < ptrdiff_t(copy.bins()); ++j) copy.add_at(j);
+		tally.expect(copy.dirty_begin() == list && copy.dirty_count() == size_t(copy.bins()));
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: copy-on-write snapshots" << std::endl;
+
+		using HistogramCow = quern::histogram<float, uint32_t, quern::binning<float>, quern::grid_storage_cow<uint32_t, 4>>;
+		const quern::binning_params<float> params{0.f, 32.f, 1000};
+		HistogramCow live(params);
+		std::deque<std::pair<HistogramCow, Histogram32>> snapshots;
+
+		// Compare a snapshot with a dense copy taken at the same time, through iterators and quantiles.
+		MismatchTally tally("Copy-on-write snapshots");
+		auto same = [&](const HistogramCow &snapshot, const Histogram32 &dense)
+		{
+			auto d = dense.begin();
+			for (auto c : snapshot) tally.expect(c == *d), ++d;
+			for (auto &q : p_quantiles)
+			{
+				auto a = quern::find_quantile_indexes(snapshot, q), b = quern::find_quantile_indexes(dense, q);
+				tally.expect(a.lower == b.lower && a.upper == b.upper);
+			}
+		};
+
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			float x = float(rand() % 3200) * .01f;
+			live.add(x);
+			if (i > 500) live.sub(float(rand() % 3200) * .01f);
+			if (i == 12000) live.clear();
+
+			if (i % 997 == 0)
+			{
+				Histogram32 dense(params);
+				for (ptrdiff_t j = 0; j < ptrdiff_t(live.bins()); ++j) dense.add_at(j, live.count_at(j));
+				snapshots.emplace_back(live, std::move(dense));
+				tally.expect(snapshots.back().first.grid().storage().shared_blocks() == size_t((live.bins() + 15) / 16));
+				if (snapshots.size() > 4) snapshots.pop_front();
+			}
+			if (i % 331 == 0) for (auto &s : snapshots) same(s.first, s.second);
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: compile-time quantile set" << std::endl;
+
+		// The same quantiles as p_quantiles.
+		using Static = quern::histogram_tracked_static<Histogram32,
+			std::ratio<1,100>, std::ratio<5,100>, std::ratio<10,100>, std::ratio<1,4>, std::ratio<1,2>,
+			std::ratio<2,4>, std::ratio<3,4>, std::ratio<90,100>, std::ratio<95,100>, std::ratio<99,100>>;
+		const quern::binning_params<float> params{0.f, 32.f, 32};
+		quern::sliding_window<Static>                                fixed  (250, params);
+		quern::sliding_window<quern::histogram_tracked<Histogram32>> dynamic(250, params, p_quantiles);
+
+		MismatchTally tally("Compile-time quantiles");
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			if (i == 11000) {fixed.clear(); dynamic.clear();}
+			float x = float(rand() % 3600) * .01f - 2.f;
+			fixed.push(x);
+			dynamic.push(x);
+
+			tally.same_quantiles(fixed.quantiles(), dynamic.quantiles());
+			for (size_t j = 0; j < fixed.quantiles().size(); ++j)
+				tally.expect(fixed.quantiles()[j].quantile == dynamic.quantiles()[j].quantile);
+		}
+		Static recalculated = fixed.tracked();
+		recalculated.recalculate();
+		tally.same_quantiles(recalculated.quantiles(), dynamic.quantiles(), false);
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: lazy quantile updates" << std::endl;
+
+		using Eager = quern::histogram_tracked<Histogram32, quern::tracked_instrument_none, quern::tracked_moments_none, quern::tracked_sums<>>;
+		using Lazy  = quern::histogram_tracked<Histogram32, quern::tracked_instrument_none, quern::tracked_moments_none, quern::tracked_sums<>, quern::tracked_update_lazy>;
+		const quern::binning_params<float> params{0.f, 32.f, 32};
+		quern::sliding_window<Eager> eager(400, params, p_quantiles);
+		quern::sliding_window<Lazy>  lazy (400, params, p_quantiles);
+
+		MismatchTally tally("Lazy quantiles");
+		for (size_t i = 0; i < 30000; ++i)
+		{
+			if (i == 17000) {eager.clear(); lazy.clear();}
+
+			// Drifting, with samples outside the binning.
+			float x = float(rand() % 2000) * .01f - 2.f + float((i / 3000) % 4) * 4.f;
+			eager.push(x);
+			lazy.push(x);
+
+			// Read rarely, at varying intervals.
+			if (i % ((i / 5000) * 97 + 1)) continue;
+			tally.same_quantiles(lazy.quantiles(), eager.quantiles());
+			double ma = lazy.tracked().trimmed_mean(3, 6), mb = eager.tracked().trimmed_mean(3, 6);
+			tally.expect(std::fabs(ma - mb) < 1e-9 || (std::isnan(ma) && std::isnan(mb)));
+		}
+		tally.report();
+	}
+
+	{
+		std::cout << "TEST: small-histogram engine and adaptive selection" << std::endl;
+
+		using Adaptive = quern::histogram_tracked_adaptive<float>;
+		const quern::binning_params<float> small{0.f, 32.f, 32}, large{0.f, 32.f, 1000}, edge{0.f, 32.f, 200};
+		quern::sliding_window<Adaptive> a_small(250, small, p_quantiles), a_large(250, large, p_quantiles), a_edge(250, edge, p_quantiles);
+		quern::sliding_window<quern::histogram_tracked<Histogram32>>
+			t_small(250, small, p_quantiles), t_large(250, large, p_quantiles), t_edge(250, edge, p_quantiles);
+
+		MismatchTally tally("Small-histogram engine");
+		tally.expect(a_small.tracked().is_small() && !a_large.tracked().is_small() && a_edge.tracked().is_small());
+		auto compare = [&](auto &a, auto &t)
+		{
+			tally.same_quantiles(a.quantiles(), t.quantiles());
+			tally.expect(a.tracked().population() == t.tracked().population());
+		};
+
+		for (size_t i = 0; i < 20000; ++i)
+		{
+			if (i == 8000) {a_small.clear(); t_small.clear(); a_edge.clear(); t_edge.clear();}
+
+			// Clustered, so some quantiles split across empty bins; some samples out of range.
+			float x = float(rand() % 9) * 4.f + float(rand() % 3) * .5f - 2.f + float((i / 2000) % 3);
+			a_small.push(x); t_small.push(x);
+			a_large.push(x); t_large.push(x);
+			a_edge .push(x); t_edge .push(x);
+
+			if (i % 3 == 0) compare(a_small, t_small);
+			if (i % 7 == 0) compare(a_large, t_large);
+			if (i % 5 == 0) compare(a_edge,  t_edge);
+		}
+
+		try {quern::histogram_small<float> too_big(large, p_quantiles); tally.expect(false);}
+		catch (std::length_error&) {}
+		tally.report();
+	}
+
+	if (failed_checks) std::cout << failed_checks << " checks failed." << std::endl;
+
+	// --batch skips the pause, for unattended runs under ctest, and exits nonzero if any check failed.
+	if (argc > 1 && std::string(argv[1]) == "--batch") {std::cout << "Complete." << std::endl; return failed_checks ? 1 : 0;}
+
 	std::cout << "Complete.  Press ENTER to close." << std::endl;
 	std::cin.ignore(255, '\n');
 }
@@ -0,0 +1,73 @@
+# Checks quern_stream's text and binary output on small generated inputs.
+#   cmake -DTOOL=<path to quern_stream> -DWORK=<scratch directory> -P quern_stream_check.cmake
+
+if(NOT TOOL OR NOT WORK)
+	message(FATAL_ERROR "TOOL and WORK must be defined")
+endif()
+
+file(MAKE_DIRECTORY "${WORK}")
+
+# u8 samples 48..57, five windows of ten.
+#   The median splits bins 52:53 and the 9/10 quantile splits 56:57,
+#   so with unit bins the reported values are 53 and 57.
+set(DIGITS "${WORK}/digits.u8")
+file(WRITE "${DIGITS}" "01234567890123456789012345678901234567890123456789")
+
+set(ARGS --type u8 --window 10 --hop 10 --min 48 --max 58 --bins 10 --quantiles 0.5,9/10 --quiet)
+
+execute_process(COMMAND "${TOOL}" ${ARGS} "${DIGITS}"
+	OUTPUT_VARIABLE text RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+	message(FATAL_ERROR "text run failed (${rc})")
+endif()
+string(REPLACE "\t" " " text "${text}")
+if(NOT text STREQUAL "10 53 57\n20 53 57\n30 53 57\n40 53 57\n50 53 57\n")
+	message(FATAL_ERROR "unexpected text output:\n${text}")
+endif()
+
+execute_process(COMMAND "${TOOL}" ${ARGS} --format binary --output "${WORK}/digits.bin" "${DIGITS}"
+	RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+	message(FATAL_ERROR "binary run failed (${rc})")
+endif()
+file(READ "${WORK}/digits.bin" binary HEX)
+set(expect
+	"0500000000000000" "0300000000000000"                   # 5 rows, 3 columns
+	"0a00000000000000" "1400000000000000" "1e00000000000000" # positions 10, 20, 30 ...
+	"2800000000000000" "3200000000000000"                   # ... 40, 50
+	"0000000000804a40" "0000000000804a40" "0000000000804a40" # 53.0 x 5
+	"0000000000804a40" "0000000000804a40"
+	"0000000000804c40" "0000000000804c40" "0000000000804c40" # 57.0 x 5
+	"0000000000804c40" "0000000000804c40")
+string(REPLACE ";" "" expect "${expect}")
+if(NOT binary STREQUAL expect)
+	message(FATAL_ERROR "unexpected binary output:\n${binary}\nexpected:\n${expect}")
+endif()
+
+# Auto-ranged over the first window (digits), then a window of letters outside it:
+#   the second row has no binned samples and must report NaN, with the rejections counted.
+set(SHIFT "${WORK}/shift.u8")
+file(WRITE "${SHIFT}" "0123456789abcdefghij")
+
+execute_process(COMMAND "${TOOL}" --type u8 --window 10 --quiet "${SHIFT}"
+	OUTPUT_VARIABLE text ERROR_VARIABLE err RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0 OR NOT text MATCHES "\n20\tnan\n$" OR NOT err MATCHES "rejected 10 samples")
+	message(FATAL_ERROR "out-of-range handling failed:\n${text}\n${err}")
+endif()
+
+execute_process(COMMAND "${TOOL}" --type u8 --window 10 --quiet --clamp "${SHIFT}"
+	OUTPUT_VARIABLE text ERROR_VARIABLE err RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0 OR NOT text MATCHES "\n20\t56\\.99" OR err MATCHES "rejected")
+	message(FATAL_ERROR "clamped run failed:\n${text}\n${err}")
+endif()
+
+# A failed write (here, a full device) must be reported and fail the run, in both formats.
+if(EXISTS "/dev/full")
+	foreach(format text binary)
+		execute_process(COMMAND "${TOOL}" ${ARGS} --format ${format} --output /dev/full "${DIGITS}"
+			ERROR_VARIABLE err RESULT_VARIABLE rc)
+		if(rc EQUAL 0 OR NOT err MATCHES "error writing")
+			message(FATAL_ERROR "${format} write failure not reported (${rc}):\n${err}")
+		endif()
+	endforeach()
+endif()
@@ -0,0 +1,364 @@
+/*
+	Randomized differential stress test for histogram_tracked.
+
+	A seeded stream of inserts, removes, replaces and clears drives a tracker
+		alongside a reference model:  exact per-bin counts plus a Fenwick tree of
+		prefix sums.  Each step checks the population and a rotating subset of
+		quantiles against the reference in O(log bins) apiece, so large
+		configurations stay cheap.  Every <check-every> steps the whole state is
+		compared, including a bin-by-bin scan of the histogram.
+
+	The stream moves through phases with different window targets and sample
+		distributions (uniform, clustered, few distinct values, out of range),
+		which exercise long walks, split quantiles and rejected samples.
+
+	Exits nonzero on the first failure, printing the seed and step to reproduce it.
+*/
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+
+#include <quern/histogram_tracked.hpp>
+
+#include "../bench/random.hpp"
+
+
+using histogram_t = quern::histogram<float>;
+using tracked_t   = quern::histogram_tracked<histogram_t, quern::tracked_instrument_counters>;
+using index_t     = histogram_t::index_t;
+using count_t     = histogram_t::count_t;
+using fraction_t  = quern::quantile_fraction<index_t>;
+
+
+namespace
+{
+	using random = quern::bench::random;
+
+	struct options
+	{
+		size_t   bins        = 1024;
+		size_t   quantiles   = 32;
+		size_t   window      = 10000;
+		uint64_t ops         = 2000000;
+		uint64_t check_every = 100000;
+		size_t   per_step    = 4;
+		uint64_t seed        = 1;
+		bool     quiet       = false;
+	};
+
+	void usage()
+	{
+		std::cout <<
+			"usage: quern_stress [options]\n"
+			"  --bins N          histogram bins (default 1024)\n"
+			"  --quantiles N     tracked quantiles, with random fractions (default 32)\n"
+			"  --window N        largest window population (default 10000)\n"
+			"  --ops N           operations to run (default 2000000)\n"
+			"  --check-every K   full consistency check interval (default 100000)\n"
+			"  --per-step N      quantiles checked after each operation (default 4)\n"
+			"  --seed N          random seed (default 1)\n"
+			"  --quiet           only report failures\n";
+	}
+
+
+	/*
+		Reference model:  exact bin counts with a Fenwick tree for prefix sums and rank search.
+	*/
+	class reference
+	{
+	public:
+		explicit reference(size_t bins) : _counts(bins, 0), _tree(bins + 1, 0), _population(0)
+		{
+			_log = 0;
+			while ((size_t(1) << (_log+1)) <= bins) ++_log;
+		}
+
+		bool accepts(index_t i) const    {return i >= 0 && size_t(i) < _counts.size();}
+
+		void add(index_t i, int64_t n)
+		{
+			if (!accepts(i)) return;
+			_counts[i] += n;
+			_population += n;
+			for (size_t k = size_t(i) + 1; k < _tree.size(); k += k & (0-k)) _tree[k] += n;
+		}
+
+		void clear()
+		{
+			std::fill(_counts.begin(), _counts.end(), 0);
+			std::fill(_tree.begin(), _tree.end(), 0);
+			_population = 0;
+		}
+
+		size_t   bins      ()          const    {return _counts.size();}
+		int64_t  population()          const    {return _population;}
+		int64_t  count     (index_t i) const    {return _counts[i];}
+
+		// Number of samples in bins below i.
+		int64_t below(index_t i) const
+		{
+			int64_t sum = 0;
+			for (size_t k = size_t(i); k; k -= k & (0-k)) sum += _tree[k];
+			return sum;
+		}
+
+		// Smallest bin i such that below(i+1) >= rank, for 1 <= rank <= population.
+		index_t search(int64_t rank) const
+		{
+			size_t pos = 0;
+			for (size_t step = size_t(1) << _log; step; step >>= 1)
+			{
+				if (pos + step < _tree.size() && _tree[pos + step] < rank)
+				{
+					pos += step;
+					rank -= _tree[pos];
+				}
+			}
+			return index_t(pos);
+		}
+
+		/*
+			The quantile range find_quantile_indexes would compute, in O(log bins).
+				lower is the first bin where the inclusive prefix reaches pop*num/den.
+				On exact equality, upper is the next nonempty bin (or the last bin).
+		*/
+		quern::quantile_range<index_t> quantile(const fraction_t &q) const
+		{
+			index_t last = index_t(bins()) - 1;
+			int64_t quota = _population * q.num, target = (quota + q.den - 1) / q.den;
+
+			quern::quantile_range<index_t> r;
+			r.lower = (target > 0) ? search(target) : 0;
+			r.upper = r.lower;
+
+			int64_t leq = below(r.lower + 1);
+			if (leq * q.den == quota)
+				r.upper = (leq < _population) ? search(leq + 1) : last;
+			return r;
+		}
+
+	private:
+		std::vector<int64_t> _counts, _tree;
+		int64_t              _population;
+		size_t               _log;
+	};
+
+
+	/*
+		Stream generator, moving through phases of differing window targets and distributions.
+	*/
+	class stream
+	{
+	public:
+		enum SHAPE {UNIFORM, CLUSTER, SPIKES, OUTLIERS, SHAPE_COUNT};
+
+		stream(const options &o) : _o(o), _rng(o.seed) {_next_phase();}
+
+		size_t target() const    {return _target;}
+		random &rng()            {return _rng;}
+
+		float sample()
+		{
+			if (!_left--) _next_phase();
+
+			double bins = double(_o.bins);
+			switch (_shape)
+			{
+			default:
+			case UNIFORM:  return float(_rng.below(_o.bins));
+			case CLUSTER:  return float(std::floor(_center + _width * (_rng.uniform() + _rng.uniform() - 1.0)));
+			case SPIKES:   return _spikes[_rng.below(_spikes.size())];
+			case OUTLIERS:
+				if (_rng.below(4)) return float(_rng.below(_o.bins));
+				return float(_rng.below(2) ? -1.0 - _rng.below(8) : bins + _rng.below(8));
+			}
+		}
+
+	private:
+		void _next_phase()
+		{
+			_left   = 1 + _rng.below(4 * _o.window + 64);
+			_target = (_rng.below(8) == 0) ? 0 : _rng.below(_o.window + 1);
+			_shape  = SHAPE(_rng.below(SHAPE_COUNT));
+			_center = double(_rng.below(_o.bins));
+			_width  = 1.0 + double(_rng.below(std::max<size_t>(_o.bins / 16, 1)));
+
+			_spikes.resize(1 + _rng.below(4));
+			for (auto &s : _spikes) s = float(_rng.below(_o.bins));
+		}
+
+		const options     &_o;
+		random             _rng;
+		uint64_t           _left = 0;
+		size_t             _target = 0;
+		SHAPE              _shape = UNIFORM;
+		double             _center = 0, _width = 1;
+		std::vector<float> _spikes;
+	};
+
+
+	/*
+		Differential checks.  Each returns false after printing a description of the failure.
+	*/
+	struct checker
+	{
+		const tracked_t &tracked;
+		const reference &ref;
+		const options   &o;
+		uint64_t         step = 0;
+
+		bool fail(const std::string &what) const
+		{
+			std::cout << "FAIL (seed " << o.seed << ", step " << step << "): " << what << std::endl;
+			return false;
+		}
+
+		bool check_population() const
+		{
+			if (int64_t(tracked.population()) == ref.population()) return true;
+			return fail("population is " + std::to_string(tracked.population())
+				+ " but should be " + std::to_string(ref.population()));
+		}
+
+		bool check_quantile(size_t i) const
+		{
+			auto &q = tracked.quantiles()[i];
+			auto expect = ref.quantile(q.quantile);
+			auto lower  = ref.below(q.index_range.upper);
+
+			std::string name = std::to_string(q.quantile.num) + "/" + std::to_string(q.quantile.den);
+			if (q.index_range.lower != expect.lower || q.index_range.upper != expect.upper)
+				return fail("quantile " + name + " is at "
+					+ std::to_string(q.index_range.lower) + ":" + std::to_string(q.index_range.upper)
+					+ " but should be at " + std::to_string(expect.lower) + ":" + std::to_string(expect.upper));
+			if (int64_t(q.samples_lower) != lower)
+				return fail("quantile " + name + " has samples_lower " + std::to_string(q.samples_lower)
+					+ " but should have " + std::to_string(lower));
+			return true;
+		}
+
+		// Compare every bin and quantile, and cross-check the reference against find_quantile_indexes.
+		bool check_full(size_t &cross) const
+		{
+			auto &hist = tracked.histogram();
+			for (size_t i = 0; i < ref.bins(); ++i)
+				if (int64_t(hist.count_at(index_t(i))) != ref.count(index_t(i)))
+					return fail("bin " + std::to_string(i) + " holds " + std::to_string(hist.count_at(index_t(i)))
+						+ " but should hold " + std::to_string(ref.count(index_t(i))));
+
+			if (!check_population()) return false;
+			for (size_t i = 0; i < tracked.quantiles().size(); ++i) if (!check_quantile(i)) return false;
+
+			if (tracked.quantiles().size())
+			{
+				auto &q = tracked.quantiles()[cross++ % tracked.quantiles().size()];
+				auto scan = quern::find_quantile_indexes(hist, q.quantile), expect = ref.quantile(q.quantile);
+				if (scan.lower != expect.lower || scan.upper != expect.upper)
+					return fail("reference model disagrees with find_quantile_indexes");
+			}
+			return true;
+		}
+	};
+}
+
+
+int main(int argc, char **argv)
+{
+	options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string {if (i+1 >= argc) {usage(); std::exit(2);} return argv[++i];};
+
+		if      (arg == "--bins")        o.bins        = std::stoull(value());
+		else if (arg == "--quantiles")   o.quantiles   = std::stoull(value());
+		else if (arg == "--window")      o.window      = std::stoull(value());
+		else if (arg == "--ops")         o.ops         = std::stoull(value());
+		else if (arg == "--check-every") o.check_every = std::stoull(value());
+		else if (arg == "--per-step")    o.per_step    = std::stoull(value());
+		else if (arg == "--seed")        o.seed        = std::stoull(value());
+		else if (arg == "--quiet")       o.quiet       = true;
+		else {usage(); return (arg == "--help") ? 0 : 2;}
+	}
+	if (!o.bins || !o.check_every) {usage(); return 2;}
+
+	stream input(o);
+
+	// Random fractions with varied denominators exercise exact-equality and split cases.
+	std::vector<fraction_t> fractions = {fraction_t(1, 2)};
+	while (fractions.size() < o.quantiles)
+	{
+		index_t den = index_t(2 + input.rng().below(999));
+		fractions.emplace_back(fraction_t(index_t(1 + input.rng().below(den - 1)), den));
+	}
+	fractions.erase(fractions.begin() + std::min(o.quantiles, fractions.size()), fractions.end());
+
+	tracked_t tracked(histogram_t::params_t{0.f, float(o.bins), quern::bindex_t(o.bins)}, fractions);
+	reference ref(o.bins);
+	checker   check{tracked, ref, o};
+
+	if (!o.quiet)
+		std::cout << "quern_stress: " << o.bins << " bins, " << o.quantiles << " quantiles, window " << o.window
+			<< ", " << o.ops << " ops, seed " << o.seed << std::endl;
+
+	// Ring buffer of samples in the window, oldest first.
+	std::vector<float> ring(o.window + 1);
+	size_t head = 0, size = 0;
+	size_t rotate = 0, cross = 0;
+
+	for (uint64_t step = 1; step <= o.ops; ++step)
+	{
+		check.step = step;
+
+		if (input.rng().below(1u << 16) == 0)
+		{
+			tracked.clear();
+			ref.clear();
+			head = size = 0;
+		}
+		else if (size < input.target() || (size == 0))
+		{
+			float x = input.sample();
+			ring[(head + size++) % ring.size()] = x;
+			tracked.insert(x);
+			ref.add(tracked.histogram().index_for(x), 1);
+		}
+		else if (size > input.target())
+		{
+			float x = ring[head];
+			head = (head + 1) % ring.size(); --size;
+			tracked.remove(x);
+			ref.add(tracked.histogram().index_for(x), -1);
+		}
+		else
+		{
+			float x = input.sample(), old = ring[head];
+			head = (head + 1) % ring.size();
+			ring[(head + size - 1) % ring.size()] = x;
+			tracked.replace(x, old);
+			ref.add(tracked.histogram().index_for(x),    1);
+			ref.add(tracked.histogram().index_for(old), -1);
+		}
+
+		if (!check.check_population()) return 1;
+		for (size_t k = 0, n = std::min(o.per_step, o.quantiles); k < n; ++k)
+			if (!check.check_quantile(rotate++ % o.quantiles)) return 1;
+
+		if (step % o.check_every == 0 || step == o.ops)
+		{
+			if (!check.check_full(cross)) return 1;
+			if (!o.quiet)
+				std::cout << "\tstep " << step << ": population " << tracked.population() << ", "
+					<< tracked.instrument().bins_walked << " bins walked, "
+					<< tracked.instrument().splits << " splits, "
+					<< tracked.instrument().rejects << " rejects" << std::endl;
+		}
+	}
+
+	if (!o.quiet) std::cout << "quern_stress: passed" << std::endl;
+	return 0;
+}
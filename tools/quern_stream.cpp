@@ -0,0 +1,447 @@
+/*
+	quern_stream:  sliding-window quantiles over raw binary sample streams.
+
+	Reads a file of native-endian samples (memory-mapped) or standard input
+		(in large chunks), runs a sliding window through histogram_tracked and
+		writes the tracked quantiles every <hop> samples.
+
+	Binary output is block-columnar.  Each block is:
+
+		uint64 rows, uint64 columns
+		uint64 position[rows]               (samples consumed at each output row)
+		double quantile[columns-1][rows]    (one column per requested quantile)
+
+	Samples outside the binning range (and NaNs) are rejected, or with --clamp
+		counted in the first or last bin.  Rows for a window holding no binned
+		samples report NaN.  The number of rejected samples is reported on stderr.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <fcntl.h>
+#endif
+
+#include <quern/window.hpp>
+#include <quern/mapped_file.hpp>
+
+
+namespace
+{
+	using histogram_t = quern::histogram<double>;
+	using tracked_t   = quern::histogram_tracked<histogram_t>;
+	using window_t    = quern::sliding_window<tracked_t>;
+	using fraction_t  = quern::quantile_fraction<histogram_t::index_t>;
+
+	enum SAMPLE_TYPE {F32, F64, I8, I16, I32, I64, U8, U16, U32, U64};
+
+	struct options
+	{
+		std::string             input = "-", output = "-";
+		SAMPLE_TYPE             type = F32;
+		size_t                  window = 1024, hop = 0;
+		std::vector<fraction_t> quantiles;
+		double                  min = 0, max = 0;
+		bool                    auto_range = true;
+		quern::bindex_t         bins = 1024;
+		bool                    binary = false, quiet = false, clamp = false;
+	};
+
+	const size_t STDIN_CHUNK  = size_t(1) << 22;
+	const size_t BLOCK_ROWS   = size_t(1) << 16;
+
+	void usage()
+	{
+		std::fprintf(stderr,
+			"usage: quern_stream [options] [input|-]\n"
+			"  --type T         sample type: f32 f64 i8 i16 i32 i64 u8 u16 u32 u64 (default f32)\n"
+			"  --window N       window length in samples (default 1024)\n"
+			"  --hop N          samples between outputs (default: window length)\n"
+			"  --quantiles L    comma-separated list, eg 0.5,0.9,0.99 or 1/2,9/10 (default 0.5)\n"
+			"  --min X --max X  binning range (default: range of the first window's samples,\n"
+			"                   fixed thereafter)\n"
+			"  --bins N         number of bins (default 1024)\n"
+			"  --clamp          count samples outside the range in the first or last bin,\n"
+			"                   instead of rejecting them\n"
+			"  --format F       text or binary (default text)\n"
+			"  --output PATH    output file (default stdout)\n"
+			"  --quiet          don't report throughput\n");
+	}
+
+	size_t sample_size(SAMPLE_TYPE t)
+	{
+		switch (t)
+		{
+		case I8:  case U8:  return 1;
+		case I16: case U16: return 2;
+		case F32: case I32: case U32: return 4;
+		default:            return 8;
+		}
+	}
+
+	// Parse a decimal ("0.99") or fractional ("99/100") quantile.
+	fraction_t parse_quantile(const std::string &text)
+	{
+		// Keep num*den and population*den well inside the index type.
+		const size_t max_digits = 9;
+
+		histogram_t::index_t num = 0, den = 1;
+		auto slash = text.find('/'), dot = text.find('.');
+		if (slash != std::string::npos)
+		{
+			num = std::stoll(text.substr(0, slash));
+			den = std::stoll(text.substr(slash+1));
+		}
+		else
+		{
+			for (size_t i = 0; i < text.size(); ++i)
+			{
+				if (i == dot) continue;
+				if (text[i] < '0' || text[i] > '9') throw std::invalid_argument("bad quantile: " + text);
+				if (dot != std::string::npos && i > dot + max_digits) throw std::invalid_argument("too many digits in quantile: " + text);
+				if (num > 999999999) throw std::invalid_argument("quantile out of range: " + text);
+				num = num*10 + (text[i]-'0');
+				if (dot != std::string::npos && i > dot) den *= 10;
+			}
+		}
+		if (den <= 0 || num <= 0 || num >= den) throw std::invalid_argument("quantile out of range: " + text);
+		if (den > 1000000000) throw std::invalid_argument("quantile denominator too large: " + text);
+		return fraction_t(num, den);
+	}
+
+	options parse_options(int argc, char **argv)
+	{
+		options o;
+		bool have_min = false, have_max = false;
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			auto value = [&]() -> std::string
+			{
+				if (i+1 >= argc) throw std::invalid_argument("missing value for " + arg);
+				return argv[++i];
+			};
+
+			if      (arg == "--window")    o.window = std::stoull(value());
+			else if (arg == "--hop")       o.hop    = std::stoull(value());
+			else if (arg == "--bins")      o.bins   = std::stoll(value());
+			else if (arg == "--min")      {o.min    = std::stod(value()); have_min = true;}
+			else if (arg == "--max")      {o.max    = std::stod(value()); have_max = true;}
+			else if (arg == "--output")    o.output = value();
+			else if (arg == "--quiet")     o.quiet  = true;
+			else if (arg == "--clamp")     o.clamp  = true;
+			else if (arg == "--format")
+			{
+				auto f = value();
+				if      (f == "text")   o.binary = false;
+				else if (f == "binary") o.binary = true;
+				else throw std::invalid_argument("unknown format: " + f);
+			}
+			else if (arg == "--type")
+			{
+				static const char *names[] = {"f32","f64","i8","i16","i32","i64","u8","u16","u32","u64"};
+				auto t = value();
+				auto found = std::find_if(std::begin(names), std::end(names), [&](const char *n) {return t == n;});
+				if (found == std::end(names)) throw std::invalid_argument("unknown type: " + t);
+				o.type = SAMPLE_TYPE(found - std::begin(names));
+			}
+			else if (arg == "--quantiles")
+			{
+				auto list = value();
+				for (size_t start = 0; start <= list.size();)
+				{
+					size_t end = std::min(list.find(',', start), list.size());
+					o.quantiles.push_back(parse_quantile(list.substr(start, end-start)));
+					start = end+1;
+				}
+			}
+			else if (arg == "--help" || arg == "-h") {usage(); std::exit(0);}
+			else if (arg.size() > 1 && arg[0] == '-' && arg != "-") throw std::invalid_argument("unknown option: " + arg);
+			else o.input = arg;
+		}
+
+		if (have_min != have_max) throw std::invalid_argument("--min and --max must be given together");
+		o.auto_range = !have_min;
+		if (!o.auto_range && !(o.max > o.min)) throw std::invalid_argument("--max must exceed --min");
+		if (o.window == 0) throw std::invalid_argument("--window must be positive");
+		if (o.bins   <= 0) throw std::invalid_argument("--bins must be positive");
+		if (o.hop == 0) o.hop = o.window;
+		if (o.quantiles.empty()) o.quantiles.push_back(fraction_t(1, 2));
+		return o;
+	}
+
+
+	/*
+		Collects output rows and writes them as text lines or columnar blocks.
+	*/
+	class output_writer
+	{
+	public:
+		output_writer(const options &o) : _name(o.output == "-" ? "stdout" : o.output), _binary(o.binary), _columns(o.quantiles.size())
+		{
+			if (o.output == "-") _file = stdout;
+			else _file = std::fopen(o.output.c_str(), _binary ? "wb" : "w");
+			if (!_file) throw std::runtime_error("cannot open output: " + o.output);
+#ifdef _WIN32
+			if (_file == stdout && _binary) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+			std::setvbuf(_file, nullptr, _IOFBF, size_t(1) << 20);
+
+			if (_binary) _values.reserve(BLOCK_ROWS * _columns);
+		}
+		~output_writer()
+		{
+			// Errors here go unreported; call close() to see them.
+			if (_file) try {close();} catch (std::exception&) {}
+		}
+
+		/*
+			Write any buffered block and close the output.
+				Throws std::runtime_error if any write failed, eg. on a full disk.
+		*/
+		void close()
+		{
+			bool failed = false;
+			try {flush();} catch (std::runtime_error&) {failed = true;}
+			failed |= (std::ferror(_file) != 0);
+			failed |= (_file != stdout) ? (std::fclose(_file) != 0) : (std::fflush(_file) != 0);
+			_file = nullptr;
+			if (failed) _fail();
+		}
+
+		void row(uint64_t position, const window_t &w)
+		{
+			auto &rule = w.histogram().binning();
+			bool empty = (w.tracked().population() == 0);
+			auto value = [&](const tracked_t::quantile &q)
+			{
+				if (empty) return std::nan("");
+				return .5 * (rule.mid({q.index_range.lower}) + rule.mid({q.index_range.upper}));
+			};
+
+			if (_binary)
+			{
+				_positions.push_back(position);
+				for (auto &q : w.quantiles()) _values.push_back(value(q));
+				if (_positions.size() >= BLOCK_ROWS) flush();
+			}
+			else
+			{
+				std::fprintf(_file, "%llu", (unsigned long long) position);
+				for (auto &q : w.quantiles())
+				{
+					if (empty) std::fputs("\tnan", _file);
+					else       std::fprintf(_file, "\t%.9g", value(q));
+				}
+				std::fputc('\n', _file);
+				if (std::ferror(_file)) _fail();
+			}
+		}
+
+		void flush()
+		{
+			if (!_binary || _positions.empty()) return;
+
+			// Transpose row-major values into columns.
+			uint64_t header[2] = {_positions.size(), _columns + 1};
+			std::vector<double> columns(_values.size());
+			for (size_t r = 0; r < _positions.size(); ++r)
+				for (size_t c = 0; c < _columns; ++c)
+					columns[c*_positions.size() + r] = _values[r*_columns + c];
+
+			bool ok =
+				std::fwrite(header,            sizeof(uint64_t), 2,                 _file) == 2 &&
+				std::fwrite(_positions.data(), sizeof(uint64_t), _positions.size(), _file) == _positions.size() &&
+				std::fwrite(columns.data(),    sizeof(double),   columns.size(),    _file) == columns.size();
+			if (!ok) _fail();
+			_positions.clear();
+			_values.clear();
+		}
+
+	private:
+		[[noreturn]] void _fail() const
+		{
+			throw std::runtime_error("error writing " + _name + ": " + std::strerror(errno));
+		}
+
+		std::string           _name;
+		std::FILE            *_file;
+		bool                  _binary;
+		size_t                _columns;
+		std::vector<uint64_t> _positions;
+		std::vector<double>   _values;
+	};
+
+
+	/*
+		Runs samples through the window, emitting output every <hop> samples once full.
+	*/
+	class stream_runner
+	{
+	public:
+		stream_runner(const options &o) : _o(o), _out(o), _consumed(0), _rejected(0) {}
+
+		template<typename T>
+		void feed(const T *samples, size_t count)
+		{
+			if (!_window)
+			{
+				quern::binning_params<double> params = {_o.min, _o.max, _o.bins};
+				if (_o.auto_range)
+				{
+					// Bin over the range of the first window's worth of samples
+					size_t n = std::min(count, _o.window);
+					if (!n) return;
+					auto range = std::minmax_element(samples, samples + n);
+					params.min = double(*range.first);
+					params.max = double(*range.second);
+					params.max += (params.max > params.min) ? (params.max - params.min) * 1e-9 : 1.0;
+				}
+				_window.reset(new window_t(_o.window, params, _o.quantiles));
+			}
+
+			auto &w    = *_window;
+			auto &rule = w.histogram().binning();
+			double low = rule.min(), last = rule.min({rule.bins()-1});
+			for (size_t i = 0; i < count; ++i)
+			{
+				double x = double(samples[i]);
+				if (!rule.accept(x))
+				{
+					if      (std::isnan(x)) x = HUGE_VAL; // always rejected
+					else if (_o.clamp)      x = (x < low) ? low : last;
+					if (!rule.accept(x)) ++_rejected;
+				}
+				w.push(x);
+				if ((++_consumed % _o.hop) == 0 && w.full()) _out.row(_consumed, w);
+			}
+		}
+
+		// Write out the last rows and close the output; throws if any write failed.
+		void finish()    {_out.close();}
+
+		uint64_t consumed() const    {return _consumed;}
+		uint64_t rejected() const    {return _rejected;}
+
+		// The binning range in use, once the first samples have arrived.
+		std::pair<double, double> range() const
+		{
+			if (!_window) return {_o.min, _o.max};
+			auto &rule = _window->histogram().binning();
+			return {rule.min(), rule.max()};
+		}
+
+	private:
+		const options            &_o;
+		output_writer             _out;
+		std::unique_ptr<window_t> _window;
+		uint64_t                  _consumed, _rejected;
+	};
+
+	template<typename T>
+	void feed_bytes(stream_runner &runner, const void *data, size_t bytes)
+	{
+		runner.feed(static_cast<const T*>(data), bytes / sizeof(T));
+	}
+
+	void feed_typed(stream_runner &runner, SAMPLE_TYPE type, const void *data, size_t bytes)
+	{
+		switch (type)
+		{
+		case F32: feed_bytes<float   >(runner, data, bytes); break;
+		case F64: feed_bytes<double  >(runner, data, bytes); break;
+		case I8:  feed_bytes<int8_t  >(runner, data, bytes); break;
+		case I16: feed_bytes<int16_t >(runner, data, bytes); break;
+		case I32: feed_bytes<int32_t >(runner, data, bytes); break;
+		case I64: feed_bytes<int64_t >(runner, data, bytes); break;
+		case U8:  feed_bytes<uint8_t >(runner, data, bytes); break;
+		case U16: feed_bytes<uint16_t>(runner, data, bytes); break;
+		case U32: feed_bytes<uint32_t>(runner, data, bytes); break;
+		case U64: feed_bytes<uint64_t>(runner, data, bytes); break;
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	options opts;
+	try
+	{
+		opts = parse_options(argc, argv);
+	}
+	catch (std::exception &e)
+	{
+		std::fprintf(stderr, "quern_stream: %s\n", e.what());
+		usage();
+		return 2;
+	}
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+		uint64_t consumed = 0, rejected = 0;
+		std::pair<double, double> range;
+		{
+			stream_runner runner(opts);
+			size_t        elem = sample_size(opts.type);
+
+			if (opts.input != "-")
+			{
+				quern::mapped_file file(opts.input);
+				feed_typed(runner, opts.type, file.data(), file.size() - file.size() % elem);
+			}
+			else
+			{
+#ifdef _WIN32
+				_setmode(_fileno(stdin), _O_BINARY);
+#endif
+				// Read large chunks, carrying any partial sample into the next chunk.
+				std::vector<char> chunk(STDIN_CHUNK);
+				size_t carry = 0;
+				while (size_t got = std::fread(chunk.data() + carry, 1, chunk.size() - carry, stdin))
+				{
+					size_t total = carry + got, whole = total - total % elem;
+					feed_typed(runner, opts.type, chunk.data(), whole);
+					carry = total - whole;
+					std::memmove(chunk.data(), chunk.data() + whole, carry);
+				}
+			}
+			runner.finish();
+			consumed = runner.consumed();
+			rejected = runner.rejected();
+			range    = runner.range();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (rejected)
+			std::fprintf(stderr, "quern_stream: rejected %llu samples outside the binning range [%g, %g)%s\n",
+				(unsigned long long) rejected, range.first, range.second, opts.auto_range ? " (see --min/--max, --clamp)" : "");
+
+		if (!opts.quiet)
+		{
+			double rate = seconds > 0 ? consumed / seconds : 0.0;
+			std::fprintf(stderr, "quern_stream: %llu samples in %.3f s (%.3g samples/s, %.3g MB/s)\n",
+				(unsigned long long) consumed, seconds, rate, rate * sample_size(opts.type) / 1e6);
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::fprintf(stderr, "quern_stream: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}